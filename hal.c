@@ -2,10 +2,33 @@
 * Hardware Abstraction Layer
 */
 
+#include "robot.c"
 #include "lib\motor.c"
 #include "lib\pid.c"
 #include "lib\tbh.c"
 #include "lib\util.c"
+#include "lib\thermal.c"
+#include "lib\traction.c"
+#include "lib\curve.c"
+#include "lib\sonar.c"
+#include "lib\jam.c"
+#include "lib\odometry.c"
+#include "lib\ballistics.c"
+#include "lib\assist.c"
+#include "lib\heading.c"
+#include "lib\profile.c"
+#include "lib\metrics.c"
+#include "lib\watchdog.c"
+#include "lib\encoder.c"
+#include "lib\feedforward.c"
+#include "lib\ballflow.c"
+#include "lib\tbhschedule.c"
+
+// Right stick deflection that triggers the aim assist
+#define ASSIST_TRIGGER 100
+
+// Flywheel changes smaller than this (RPM) from ballistics are ignored, so TBH isn't constantly retargeted
+#define FLYWHEEL_AUTO_DEADBAND 25
 
 enum motorMode {
 	STOP = 0,
@@ -16,13 +39,8 @@ enum motorMode {
 
 typedef struct {
 
-	// Drive - Motor Values
-	int leftDrive;
-	int rightDrive;
-
-	// Drive Directional Control
-	int forward;
-	int turn;
+	// Larger members first and flags packed together at the end, so nothing is wasted on padding
+	// (see memory.c for the budget)
 
 	// Drive PIDs (actually just p-loops but whatever)
 	PIDController driveController;
@@ -30,15 +48,54 @@ typedef struct {
 
 	// Flywheel
 	TBHController flywheel;
-	bool disableFlywheelControl;
+
+	// Heading (see heading.c)
+	HeadingService heading;
+
+	Odometry pose;
+
+	// Aim assist (right stick)
+	HeadingAssist assist;
+
+	SonarFilter ballSonar;
+
+	// Jam detection
+	JamDetector indexerJam;
+	JamDetector intakeJam;
+
+	long lastMeasure;
+
+	// Double Shot reset timer
+	long resetCounter;
+
+	// Drive Encoder Velocity (ticks per second)
+	short leftVelocity;
+	short rightVelocity;
+
+	// Drive - Motor Values
+	short leftDrive;
+	short rightDrive;
+
+	// Drive Directional Control
+	short forward;
+	short turn;
 
 	motorMode intake;
 	motorMode indexer;
 
-	motorMode descore;
+	// indexer override
+	motorMode indexerOverride;
 
-	// Cap Flipper power
-	int capFlipper;
+	// Automatic flywheel targeting from position (-1 when off, otherwise the flag to aim for)
+	byte flywheelAutoFlag;
+
+	// Double Shot (0 = inactive, 1 = before first shot, 2 = before second shot)
+	ubyte doubleShotMode;
+
+	// Flags
+	bool disableFlywheelControl;
+	bool driveOverride; // leftDrive/rightDrive are set by a routine (like sysid) in driver control, ignore the sticks
+	bool assistTriggered;
 
 	// Fire Button -- Robot should fire ball when ready
 	bool firing;
@@ -46,26 +103,129 @@ typedef struct {
 	// Ball is ready to fire
 	bool ballLoaded;
 
-	// Double Shot (0 = inactive, 1 = before first shot, 2 = before second shot)
-	int doubleShotMode;
-	int resetCounter;
-
-	// indexer override
-	motorMode indexerOverride;
-
 } HardwareAbstraction;
 
 
 HardwareAbstraction robot;
 
+MotorGroup driveLeftMotors;
+MotorGroup driveRightMotors;
+MotorGroup descoreMotors;
+
+TractionController leftTraction;
+TractionController rightTraction;
+
+// Encoder health (see encoder.c)
+EncoderHealth flywheelEncoder;
+EncoderHealth leftEncoder;
+EncoderHealth rightEncoder;
+
+// Flywheel voltage that holds each speed, learned while the encoder is healthy
+FeedForward flywheelHold;
+
+// Flywheel gains by setpoint and battery voltage (see tbhschedule.c)
+TBHSchedule flywheelSchedule;
+
+// Tunables (these can all be changed live from the serial console)
+int flywheelPresets[3] = { 2600, 2400, 2500 }; // Btn7U, Btn7R, Btn7L
+int doubleShotHold = 39; // Flywheel power held between double shots
+int fireMaxError = 100;  // Largest flywheel error (RPM) we will fire at
+int fireMinSetpoint = 1000;
+int indexerPower = 70; // Indexer power catching and feeding balls
+int doubleShotReset = 2000; // ms after the second ball of a double shot before it resets
+
+/**
+ * Zeroes the drive encoders, without the HAL seeing a jump in velocity
+ */
+void resetDriveEncoders() {
+	hogCPU();
+	SensorValue[leftDrive] = 0;
+	SensorValue[rightDrive] = 0;
+	resetEncoder(leftEncoder, 0);
+	resetEncoder(rightEncoder, 0);
+	releaseCPU();
+}
+
+/**
+ * Estimates the change on a drive side whose encoder has failed, from the healthy side
+ * @param int change The change measured on the healthy side
+ * @param int power The power on the healthy side
+ * @param int failedPower The power on the failed side
+ * @param int dt ms since the last measurement
+ */
+int driveFallbackChange(int change, int power, int failedPower, int dt) {
+	// Both sides follow the same curve, so scale by the ratio of their commands
+	if (abs(power) > 10) {
+		return change * failedPower / power;
+	}
+
+	// Turning on the spot about the healthy side, all we have is the open loop speed
+	return failedPower * DRIVE_FREE_SPEED / 127 * dt / 1000;
+}
+
+void measureStep() {
+	int dt = nSysTime - robot.lastMeasure;
+	if(dt <= 0) {
+		return;
+	}
+
+	int leftChange = stepEncoder(leftEncoder, SensorValue[leftDrive], robot.leftDrive);
+	int rightChange = stepEncoder(rightEncoder, SensorValue[rightDrive], robot.rightDrive);
+
+	// A bad encoder costs accuracy, not the match: measure it off the other side
+	if (!leftEncoder.healthy && rightEncoder.healthy) {
+		leftChange = driveFallbackChange(rightChange, robot.rightDrive, robot.leftDrive, dt);
+	} else if (!rightEncoder.healthy && leftEncoder.healthy) {
+		rightChange = driveFallbackChange(leftChange, robot.leftDrive, robot.rightDrive, dt);
+	}
+
+	float headingChange = stepHeading(robot.heading, SensorValue[gyro], leftChange, rightChange,
+		robot.leftDrive != 0 || robot.rightDrive != 0, leftEncoder.healthy && rightEncoder.healthy);
+	watchdogSetDegraded(DEGRADED_GYRO, robot.heading.gyroSuspect);
+
+	robot.leftVelocity = leftChange * 1000 / dt;
+	robot.rightVelocity = rightChange * 1000 / dt;
+
+	stepOdometry(robot.pose, leftChange, rightChange, headingChange);
+
+	robot.lastMeasure = nSysTime;
+}
+
+void thermalUpdateStep() {
+	thermalSetGroupSpeed(driveLeftMotors, robot.leftVelocity / DRIVE_FREE_SPEED);
+	thermalSetGroupSpeed(driveRightMotors, robot.rightVelocity / DRIVE_FREE_SPEED);
+	thermalSetSpeed(FlywheelOut, robot.flywheel.process / robot.flywheel.maxRPM);
+
+	thermalStep();
+}
+
+/**
+ * Whether the flywheel is fast enough, and close enough to its setpoint, to fire
+ */
+bool flywheelReady() {
+	return robot.flywheel.error < fireMaxError && robot.flywheel.setpoint > fireMinSetpoint;
+}
+
 void flywheelStep() {
-	// Targeting
+	// Automatic targeting, from where we are on the field
+	if(robot.flywheelAutoFlag >= 0) {
+		int rpm = ballisticsForPose(robot.pose, robot.flywheelAutoFlag);
+		if(abs(rpm - robot.flywheel.setpoint) > FLYWHEEL_AUTO_DEADBAND) {
+			targetTBH(robot.flywheel, rpm);
+		}
+	}
+
+	// Targeting (any manual choice turns automatic targeting off)
+	if(vexRT[Btn7U] || vexRT[Btn7R] || vexRT[Btn7L] || vexRT[Btn7D]) {
+		robot.flywheelAutoFlag = -1;
+	}
+
 	if(vexRT[Btn7U]) {
-		targetTBH(robot.flywheel, 2600);
+		targetTBH(robot.flywheel, flywheelPresets[0]);
 	} else if(vexRT[Btn7R]) {
-		targetTBH(robot.flywheel, 2400);
+		targetTBH(robot.flywheel, flywheelPresets[1]);
 	} else if  (vexRT[Btn7L]) {
-		targetTBH(robot.flywheel, 2500)
+		targetTBH(robot.flywheel, flywheelPresets[2]);
 	} else if(vexRT[Btn7D]) {
 		targetTBH(robot.flywheel, 0);
 	}
@@ -85,12 +245,12 @@ void flywheelStep() {
 
 
 	// Detect Balls for Firing Control
-	robot.ballLoaded = SensorValue[ballDetector] <= 10;
+	robot.ballLoaded = stepSonar(robot.ballSonar, SensorValue[ballDetector]);
 
 
 	// Double Shot: Activate
 	if (vexRT[Btn5D] && robot.doubleShotMode == 0 && robot.ballLoaded) {
-		writeDebugStreamLine("Activate")
+		writeDebugStreamLine("Activate");
 		robot.firing = true;
 		robot.doubleShotMode = 1;
 		robot.intake = REVERSE;
@@ -100,10 +260,10 @@ void flywheelStep() {
 	if (robot.doubleShotMode == 1 && abs(robot.flywheel.error) > 300) {
 		robot.disableFlywheelControl = true;
 		// Set to hold power for second shot
-		if (robot.flywheel.setpoint == 2600) {
+		if (robot.flywheel.setpoint == flywheelPresets[0]) {
 			robot.flywheel.output = 0;
 		} else {
-			robot.flywheel.output = 39;
+			robot.flywheel.output = doubleShotHold;
 		}
 
 		robot.doubleShotMode = 2;
@@ -114,15 +274,15 @@ void flywheelStep() {
 
 	// Double Shot: Fire 2nd Ball
 	if(robot.doubleShotMode == 2) {
-		writeDebugStreamLine("Second Shot")
+		writeDebugStreamLine("Second Shot");
 		robot.indexerOverride = FORWARD;
-		robot.doubleShotMode = 3
+		robot.doubleShotMode = 3;
 		robot.resetCounter = nSysTime;
 	}
 
 	// Double Shot: Reset (via a timeout)
-	if(robot.doubleShotMode == 3 && !robot.ballLoaded && nSysTime - robot.resetCounter > 2000) {
-		writeDebugStreamLine("Reset")
+	if(robot.doubleShotMode == 3 && !robot.ballLoaded && nSysTime - robot.resetCounter > doubleShotReset) {
+		writeDebugStreamLine("Reset");
 		robot.indexerOverride = STOP;
 		robot.intake = STOP;
 		robot.doubleShotMode = 0;
@@ -131,8 +291,11 @@ void flywheelStep() {
 
 
 
+	// Can't tell whether there is a ball (stale sonar, or still filling its window), so keep it wherever it is
+	if(!robot.ballSonar.known) {
+		robot.indexer = STOP;
 	// When to fire: if a ball is loaded, the flywheel error is sufficently small, and the flywheel speed is above a threshold
-	if(robot.ballLoaded && robot.flywheel.error < 100 && robot.flywheel.setpoint > 1000 && robot.firing) {
+	} else if(robot.ballLoaded && flywheelReady() && robot.firing) {
 		robot.indexer = FORWARD;
 	// Hold balls and prepare to fire
 	} else if(robot.ballLoaded) {
@@ -145,10 +308,24 @@ void flywheelStep() {
 
 
 	// Flywheel Itself
-	calculateProcessTBH(robot.flywheel);
+	stepEncoder(flywheelEncoder, SensorValue[flywheel], motor[FlywheelOut]);
+	calculateProcessTBHFrom(robot.flywheel, flywheelEncoder.position);
+
+	float volts = batteryVolts();
+	bool degraded = (watchdog.degraded & DEGRADED_FLYWHEEL) != 0;
 
-	if (!robot.disableFlywheelControl) {
+	stepSchedule(flywheelSchedule, robot.flywheel, flywheelHold, volts, fireMaxError,
+		!degraded && !robot.disableFlywheelControl);
+
+	if (degraded) {
+		// Speed can't be trusted, so hold the voltage that was last seen to hold this setpoint
+		robot.flywheel.output = clamp(feedForward(flywheelHold, robot.flywheel.setpoint) * 127 / volts, -127, 127);
+	} else if (!robot.disableFlywheelControl) {
 		stepTBH(robot.flywheel);
+
+		if (abs(robot.flywheel.error) < fireMaxError && robot.flywheel.setpoint > 0) {
+			learnFeedForward(flywheelHold, robot.flywheel.setpoint, robot.flywheel.output * volts / 127);
+		}
 	}
 
 
@@ -159,10 +336,28 @@ void flywheelStep() {
 
 void driveStep() {
 	// Arcade Drive
-	if(!bIfiAutonomousMode) {
-		int forward = logistic(vexRT[Ch3]),
-			turn = logistic(vexRT[Ch4]);
+	if(!bIfiAutonomousMode && !robot.driveOverride) {
+		int forward = curve(vexRT[Ch3]),
+			turn = curve(vexRT[Ch4]);
+
+
+		// Aim assist: flick the right stick left/right to snap to the next stored heading, or push it up to
+		// face the flags (and track the high flag's RPM). Releases once there, or as soon as the driver turns
+		if(abs(vexRT[Ch1]) > ASSIST_TRIGGER || vexRT[Ch2] > ASSIST_TRIGGER) {
+			if(!robot.assistTriggered) {
+				if(vexRT[Ch2] > ASSIST_TRIGGER) {
+					robot.flywheelAutoFlag = FLAG_HIGH;
+					assistTurnTo(robot.assist, odometryBearingTo(robot.pose, ballisticsTargetX, ballisticsTargetY[ballisticsAlliance]), robot.pose.heading);
+				} else {
+					assistSnap(robot.assist, robot.pose.heading, -sgn(vexRT[Ch1]));
+				}
+			}
+			robot.assistTriggered = true;
+		} else {
+			robot.assistTriggered = false;
+		}
 
+		turn = stepAssist(robot.assist, robot.pose.heading, turn);
 
 		robot.forward = forward;
 		robot.turn = turn;
@@ -172,15 +367,23 @@ void driveStep() {
 		robot.rightDrive = forward - turn;
 	}
 
-    // Note: Back A motors are INTENTIONALLY reversed
-	motorTarget[DriveFL] = robot.leftDrive;
-	motorTarget[DriveBLB] = robot.leftDrive;
-
-	motorTarget[DriveFR] = -robot.rightDrive;
-	motorTarget[DriveBRB] = -robot.rightDrive;
+	motorGroupSet(driveLeftMotors, stepTraction(leftTraction, robot.leftDrive, robot.leftVelocity * 127 / DRIVE_FREE_SPEED));
+	motorGroupSet(driveRightMotors, stepTraction(rightTraction, robot.rightDrive, robot.rightVelocity * 127 / DRIVE_FREE_SPEED));
 }
 
 
+/**
+ * Whether the battery is sagging like a stalled intake or indexer would make it. The drive and the flywheel
+ * spinning up pull far more, and a stalled descore arm pulls as much, so any sag while one of them is working
+ * says nothing about the rollers. Call after the descore motors are set
+ */
+bool jamSagging(JamDetector & detector) {
+	return nAvgBatteryLevel - nImmediateBatteryLevel > detector.sagThreshold &&
+		abs(robot.leftDrive) < 20 && abs(robot.rightDrive) < 20 &&
+		motorTarget[DescoreL] == 0 && motorTarget[DescoreR] == 0 &&
+		abs(robot.flywheel.output) < 127 && abs(robot.flywheel.error) <= robot.flywheel.bangBang;
+}
+
 void takerStep() {
 
 	if(vexRT[Btn6U])  {
@@ -203,29 +406,31 @@ void takerStep() {
 
 	// Descore
 	if (vexRT[Btn8L]) {
-		motorTarget[DescoreL] = 127;
-		motorTarget[DescoreR] = 127;
+		motorGroupSet(descoreMotors, 127);
 	} else if (vexRT[Btn8R]) {
-		motorTarget[DescoreL] = -127;
-		motorTarget[DescoreR] = -127;
+		motorGroupSet(descoreMotors, -127);
 	} else {
-		motorTarget[DescoreL] = 0;
-		motorTarget[DescoreR] = 0;
+		motorGroupSet(descoreMotors, 0);
 	}
 
 
 	switch(robot.indexer) {
 		case FORWARD:
-			motorTarget[Indexer] = 70;
+			motorTarget[Indexer] = indexerPower;
 			break;
 		case REVERSE:
-			motorTarget[Indexer] = -70;
+			motorTarget[Indexer] = -indexerPower;
 			break;
 		case STOP:
 			motorTarget[Indexer] = 0;
 			break;
 	}
 
+	// Without the ball detector the indexer can't tell when to stop, so only move it on request
+	if(watchdog.degraded & DEGRADED_INDEXER) {
+		motorTarget[Indexer] = robot.indexerOverride == FORWARD ? indexerPower : 0;
+	}
+
 	switch(robot.intake) {
 		case FORWARD:
 			motorTarget[Intake] = 127;
@@ -237,17 +442,147 @@ void takerStep() {
 			motorTarget[Intake] = 0;
 			break;
 	}
+
+	// Jams: the indexer is stuck if it is pushing a loaded ball that doesn't leave (sooner if it is also pulling
+	// stall current), the intake if it is pulling stall current
+	motorTarget[Indexer] = stepJam(robot.indexerJam, motorTarget[Indexer],
+		motorTarget[Indexer] > 0 && robot.ballLoaded, jamSagging(robot.indexerJam), robot.ballSonar.lastTransition);
+	motorTarget[Intake] = stepJam(robot.intakeJam, motorTarget[Intake],
+		jamSagging(robot.intakeJam), false, robot.ballSonar.lastTransition);
 }
 
-task hardwareAbstractionLayer() {
-	initTBH(robot.flywheel, 0.0015, 3500, flywheel, 5.0);
+// Whether the HAL task has been started (it is only ever started once, and kept alive between modes)
+bool halRunning = false;
+bool halInitialized = false;
+
+/**
+ * Initializes controller state. Only runs once, so that controller state (and anything tuned from the
+ * console before the match) carries across the transition from autonomous to driver control
+ */
+void initHAL() {
+	if(halInitialized) {
+		return;
+	}
+
+	initTBH(robot.flywheel, ROBOT_FLYWHEEL_KI, ROBOT_FLYWHEEL_MAX_RPM, flywheel, FLYWHEEL_RPM_PER_TICK_MS);
 	targetTBH(robot.flywheel, 0);
 
+	thermalInit();
+	initMetrics();
+	resetFlow();
+
+	// If the HAL stalls, hold the flywheel at a gentle open-loop power and stop everything else
+	watchdogHold[FlywheelOut] = 50;
+
+	initOdometry(robot.pose, DRIVE_INCHES_PER_TICK);
+	resetOdometry(robot.pose, 0, 0, 0);
+
+	initHeading(robot.heading, 1.0, DRIVE_INCHES_PER_TICK / DRIVE_TRACK_WIDTH * DEGREES_PER_RADIAN);
+	resetHeading(robot.heading, SensorValue[gyro]);
+	robot.flywheelAutoFlag = -1;
+
+	initAssist(robot.assist, 2.5, 90, 40, 2);
+
+	// Loaded at 10cm like before, unloaded past 14cm, and stop trusting it after 200ms without a valid ping
+	initSonar(robot.ballSonar, 10, 14, 200);
+
+	initJam(robot.indexerJam, 750, 300, 150, 250);
+	initJam(robot.intakeJam, 1000, 300, 250, 250);
+
+	initDriverProfiles();
+	useDriverProfile(driverProfile);
+
+	initTraction(leftTraction, 0.4, 30);
+	initTraction(rightTraction, 0.4, 30);
+
+	// Flywheel tops out around 4 ticks per ms, the drive under 2. Direction is judged above about 400 RPM on the
+	// flywheel and a fifth of free speed on the drive
+	initEncoder(flywheelEncoder, 10, 0.5, 40, 300, 250);
+	initEncoder(leftEncoder, 5, 0.3, 40, 500, 750);
+	initEncoder(rightEncoder, 5, 0.3, 40, 500, 750);
+	resetEncoder(flywheelEncoder, SensorValue[flywheel]);
+	resetEncoder(leftEncoder, SensorValue[leftDrive]);
+	resetEncoder(rightEncoder, SensorValue[rightDrive]);
+
+	// Straight line up to the flywheel's top speed at a nominal battery, until learned
+	initFeedForward(flywheelHold, robot.flywheel.maxRPM, 7.5, 0.02);
+	initSchedule(flywheelSchedule, robot.flywheel.Ki, robot.flywheel.bangBang);
+
+	// Drive (reversals are in robot.c)
+	motorGroupInit(driveLeftMotors);
+	motorGroupAdd(driveLeftMotors, DriveFL, ROBOT_DRIVE_LEFT_REVERSED);
+	motorGroupAdd(driveLeftMotors, DriveBLB, ROBOT_DRIVE_LEFT_REVERSED);
+	motorGroupConfigure(driveLeftMotors, MOTOR_SLEW_NONE, 15, true);
+
+	motorGroupInit(driveRightMotors);
+	motorGroupAdd(driveRightMotors, DriveFR, ROBOT_DRIVE_RIGHT_REVERSED);
+	motorGroupAdd(driveRightMotors, DriveBRB, ROBOT_DRIVE_RIGHT_REVERSED);
+	motorGroupConfigure(driveRightMotors, MOTOR_SLEW_NONE, 15, true);
+
+	motorGroupInit(descoreMotors);
+	motorGroupAdd(descoreMotors, DescoreL, false);
+	motorGroupAdd(descoreMotors, DescoreR, false);
+	motorGroupConfigure(descoreMotors, MOTOR_SLEW_NONE, 15, true);
+
+	halInitialized = true;
+}
+
+/**
+ * One HAL cycle: measure, decide, and set the motors. The host simulator (tools/host) calls this directly
+ */
+void halStep() {
+	watchdogHeartbeat();
+	profileBegin(PROFILE_HAL);
+
+	profileBegin(PROFILE_MEASURE);
+	measureStep();
+	profileEnd(PROFILE_MEASURE);
+
+	profileBegin(PROFILE_DRIVE);
+	driveStep();
+	profileEnd(PROFILE_DRIVE);
+
+	profileBegin(PROFILE_TAKER);
+	takerStep();
+	profileEnd(PROFILE_TAKER);
+
+	profileBegin(PROFILE_FLYWHEEL);
+	flywheelStep();
+	metricsStep(robot.flywheel, fireMaxError);
+	flowStep(robot.ballLoaded, motorTarget[Indexer] > 0, flywheelReady(), robot.doubleShotMode == 3, robot.ballSonar.latency);
+	profileEnd(PROFILE_FLYWHEEL);
+
+	profileBegin(PROFILE_MOTOR);
+	motorControlStep();
+	watchdogSensors(flywheelEncoder.healthy, leftEncoder.healthy && rightEncoder.healthy, robot.ballSonar.lastValid);
+	profileEnd(PROFILE_MOTOR);
+
+	profileBegin(PROFILE_THERMAL);
+	thermalUpdateStep();
+	profileEnd(PROFILE_THERMAL);
+
+	profileEnd(PROFILE_HAL);
+	profilePublish();
+}
+
+task hardwareAbstractionLayer() {
 	while(true) {
-		driveStep();
-		takerStep();
-		flywheelStep();
-		motorControlStep();
+		halStep();
 		wait1Msec(20);
 	}
 }
+
+/**
+ * Starts the HAL if it isn't already running. Safe to call from every mode
+ */
+void startHAL() {
+	if(halRunning) {
+		return;
+	}
+
+	initHAL();
+	profileCalibrate();
+	halRunning = true;
+	startTask(hardwareAbstractionLayer);
+	watchdogStart();
+}
@@ -0,0 +1,90 @@
+/**
+ * assist.c - Driver assist for aiming
+ *
+ * While active, turns the robot to a target heading with a P-loop, on top of whatever the driver is doing.
+ * Moving the turn stick past overrideThreshold hands control straight back to the driver.
+ */
+
+#pragma systemFile
+
+#include "util.c"
+
+#define ASSIST_HEADING_COUNT 8
+
+// Headings (degrees) the assist can snap to, counterclockwise from the starting direction
+float assistHeadings[ASSIST_HEADING_COUNT] = { 0, 45, 90, 135, 180, 225, 270, 315 };
+
+typedef struct {
+    bool active;
+    float target; // Heading to turn to, in the same (unwrapped) degrees as the robot's heading
+
+    float Kp;
+    int maxTurn;           // Most turn power the assist will use
+    int overrideThreshold; // Driver turn input that cancels the assist
+    float tolerance;       // Degrees, the assist finishes once within this (and slowed down)
+} HeadingAssist;
+
+void initAssist(HeadingAssist & assist, float Kp, int maxTurn, int overrideThreshold, float tolerance) {
+    assist.active = false;
+    assist.Kp = Kp;
+    assist.maxTurn = maxTurn;
+    assist.overrideThreshold = overrideThreshold;
+    assist.tolerance = tolerance;
+}
+
+/**
+ * Wraps an angle to -180 - 180
+ */
+float wrapDegrees(float degrees) {
+    return degrees - 360 * floor((degrees + 180) / 360);
+}
+
+/**
+ * Starts turning to face a field heading, whichever way round is shorter
+ */
+void assistTurnTo(HeadingAssist & assist, float heading, float current) {
+    assist.target = current + wrapDegrees(heading - current);
+    assist.active = true;
+}
+
+/**
+ * Starts turning to the next stored heading
+ * @param int direction 1 for counterclockwise (left), -1 for clockwise (right)
+ */
+void assistSnap(HeadingAssist & assist, float current, int direction) {
+    float best = 360;
+    float offset;
+
+    // Smallest turn in the requested direction that's more than just a nudge
+    for(int i = 0; i < ASSIST_HEADING_COUNT; i++) {
+        offset = wrapDegrees(assistHeadings[i] - current) * direction;
+        if (offset <= assist.tolerance) offset += 360;
+        if (offset < best) best = offset;
+    }
+
+    assist.target = current + best * direction;
+    assist.active = true;
+}
+
+/**
+ * @param float current The robot's heading
+ * @param int driverTurn The driver's turn input (positive turns right)
+ * @return int The turn power to use (positive turns right)
+ */
+int stepAssist(HeadingAssist & assist, float current, int driverTurn) {
+    if (!assist.active) return driverTurn;
+
+    if (abs(driverTurn) > assist.overrideThreshold) {
+        assist.active = false;
+        return driverTurn;
+    }
+
+    float error = assist.target - current;
+    if (abs(error) < assist.tolerance) {
+        assist.active = false;
+        return driverTurn;
+    }
+
+    // Heading is counterclockwise, turn power is clockwise
+    return clamp(-assist.Kp * error, -assist.maxTurn, assist.maxTurn) + driverTurn;
+}
@@ -5,6 +5,7 @@
 #include "../hal.c"
 #include "pid.c"
 #include "lcd.c"
+#include "sysid.c"
 
 #define ALLIANCE_RED  0
 #define ALLIANCE_BLUE 1
@@ -16,8 +17,12 @@
 
 #pragma systemFile
 
+// Inches to drive encoder ticks for this robot, folded at compile time (see robot.c). drive(INCHES(24))
+#define INCHES(n) ((n) * DRIVE_TICKS_PER_INCH)
+
 /**
- * Converts inches to quadrature encoder ticks, for the purpose of setting targets in PIDs
+ * Converts inches to quadrature encoder ticks, for the purpose of setting targets in PIDs (for drivetrains other
+ * than the one in robot.c, otherwise use INCHES)
  * Usage:
  *  inchesToTicks(10, 3.25, 1, TURBO);
  *
@@ -40,15 +45,18 @@ typedef struct {
 
 matchConfiguration match;
 
+// Movement gains (tunable from the serial console)
+float driveKp = ROBOT_DRIVE_KP;
+float turnKp = ROBOT_TURN_KP;
+
 
 // Drives a specific distance (forward, use negative for backwards) in ticks
 void drive(int distance) {
 
-    SensorValue[leftDrive] = 0;
-    SensorValue[rightDrive] = 0;
+    resetDriveEncoders();
 
     // Configure PID
-    configurePID(robot.driveController, 1.6, 0, 0);
+    configurePID(robot.driveController, driveKp, 0, 0);
     targetPID(robot.driveController, distance);
 
     do {
@@ -57,6 +65,9 @@ void drive(int distance) {
 
         robot.leftDrive = robot.driveController.output * 0.7;
         robot.rightDrive = robot.driveController.output * 0.7;
+
+        // Sensors only update once a HAL cycle, don't starve the HAL spinning on them
+        wait1Msec(20);
     } while(abs(robot.driveController.output) > 20);
 
     // Break
@@ -70,8 +81,7 @@ void drive(int distance) {
 
 void driveMax(int distance) {
 
-    SensorValue[leftDrive] = 0;
-    SensorValue[rightDrive] = 0;
+    resetDriveEncoders();
 
     while(abs(SensorValue[leftDrive]) < abs(distance)) {
         robot.leftDrive = sgn(distance) * 127;
@@ -90,8 +100,7 @@ void driveMax(int distance) {
 }
 
 void driveCoast(int distance) {
-    SensorValue[leftDrive] = 0;
-    SensorValue[rightDrive] = 0;
+    resetDriveEncoders();
 
     while(abs(SensorValue[leftDrive]) < abs(distance)) {
         robot.leftDrive = sgn(distance) * 90;
@@ -106,10 +115,91 @@ void driveCoast(int distance) {
 
 
 /**
- * Find the "absolute" gyro position (Always 0 - 360) in DEGREES!
+ * Follows a trapezoidal profile (speed up, cruise, slow down) with power from the measured drive model (see sysid.c),
+ * plus a P correction on how far behind or ahead of the profile we are
+ * @param int motion SYSID_LINEAR (ticks) or SYSID_ANGULAR (degrees, counterclockwise)
+ * @param float distance How far to move, negative for backwards (or clockwise)
+ * @param float speed Cruise speed, units per second (must be positive)
+ * @param float accel Acceleration, units per second per second (must be positive)
+ */
+void profiledMove(int motion, float distance, float speed, float accel) {
+    if (speed <= 0 || accel <= 0) {
+        writeDebugStreamLine("profiledMove: speed %f and accel %f must be positive", speed, accel);
+        return;
+    }
+
+    float length = abs(distance);
+    int direction = sgn(distance);
+    if (length == 0) return;
+
+    // Too short to reach cruise speed, the profile is a triangle instead
+    if (speed * speed / accel > length) {
+        speed = sqrt(length * accel);
+    }
+
+    float accelTime = speed / accel;
+    float cruiseTime = (length - speed * accelTime) / speed;
+    float totalTime = 2 * accelTime + cruiseTime;
+
+    float start = sysidPosition(motion);
+    float kP = motion == SYSID_ANGULAR ? turnKp : driveKp;
+    long moveStart = nSysTime;
+    float t, target, velocity, acceleration, power;
+
+    do {
+        t = (nSysTime - moveStart) / 1000.0;
+
+        if (t < accelTime) {
+            acceleration = accel;
+            velocity = accel * t;
+            target = 0.5 * accel * t * t;
+        } else if (t < accelTime + cruiseTime) {
+            acceleration = 0;
+            velocity = speed;
+            target = speed * (t - 0.5 * accelTime);
+        } else if (t < totalTime) {
+            float remaining = totalTime - t;
+            acceleration = -accel;
+            velocity = accel * remaining;
+            target = length - 0.5 * accel * remaining * remaining;
+        } else {
+            acceleration = 0;
+            velocity = 0;
+            target = length;
+        }
+
+        float error = target - direction * (sysidPosition(motion) - start);
+        float feedForward = motion == SYSID_ANGULAR ?
+            driveFeedForward(angularModel, velocity, acceleration) : driveFeedForward(linearModel, velocity, acceleration);
+
+        power = clamp(direction * (feedForward + kP * error), -127, 127);
+        sysidApply(motion, power);
+
+        wait1Msec(20);
+
+        // Let the correction finish the move, but not forever
+    } while(t < totalTime || (abs(power) > 20 && t < totalTime + 0.5));
+
+    sysidApply(motion, 0);
+}
+
+// No routine uses the profiled moves yet: the model in robot.c is an estimate until sysid has measured it there
+
+// Drives a distance (ticks, negative for backwards) along a profile. Speeds in ticks per second
+void driveProfiled(int distance, float speed, float accel) {
+    profiledMove(SYSID_LINEAR, distance, speed, accel);
+}
+
+// Turns by some degrees (counterclockwise) along a profile. Speeds in degrees per second
+void turnProfiled(float degrees, float speed, float accel) {
+    profiledMove(SYSID_ANGULAR, degrees, speed, accel);
+}
+
+/**
+ * Find the "absolute" direction (Always 0 - 360) of a continuous heading, in DEGREES!
  */
-float absoluteDirection(int measurement) {
-    return ((measurement < 0 ? 3600 + measurement : measurement) % 3600) / 10.0;
+float absoluteDirection(float degrees) {
+    return fmodf(degrees, 360);
 }
 
 /**
@@ -122,18 +212,21 @@ float absoluteDirection(int measurement) {
 void turn(int degrees) {
 
     // Configure PID
-    configurePID(robot.turnController, 1, 0, 0);
+    configurePID(robot.turnController, turnKp, 0, 0);
     targetPID(robot.turnController, degrees);
 
-    SensorValue[gyro] = 0;
+    // Measured from where we are now (the gyro isn't zeroed, odometry depends on it)
+    float start = robot.heading.angle;
 
     do {
-        robot.turnController.value = SensorValue[gyro] / 10.0;
+        robot.turnController.value = robot.heading.angle - start;
         stepPID(robot.turnController);
 
         // Turn at constant rate
-        robot.leftDrive = -50 * sgn(degrees);  
+        robot.leftDrive = -50 * sgn(degrees);
         robot.rightDrive = 50 * sgn(degrees);
+
+        wait1Msec(20);
     } while(abs(robot.turnController.output) > 20);
 
     // Break
@@ -146,6 +239,16 @@ void turn(int degrees) {
     robot.rightDrive = 0;
 }
 
+/**
+ * Keeps the flywheel at the right speed for a flag from wherever the robot is, so it can spin up while driving.
+ * Overrides targetTBH until aimFlywheel(-1), or a manual preset in driver control
+ * @param int flag FLAG_HIGH or FLAG_MIDDLE (anything else stops)
+ */
+void aimFlywheel(int flag) {
+    ballisticsAlliance = match.alliance;
+    robot.flywheelAutoFlag = (flag == FLAG_HIGH || flag == FLAG_MIDDLE) ? flag : -1;
+}
+
 void fire() {
     robot.firing = true;
     while(robot.firing)  {
@@ -224,7 +327,7 @@ void autonBackfield() {
 
     wait1Msec(1000);
 
-    driveMax(750)
+    driveMax(750);
 }
 
 void autonFrontfieldOld() {
@@ -269,8 +372,8 @@ void autonFrontfieldOld() {
 }
 
 void autonFrontfield() {
-    // Target flywheel early so we don't have to waste time waiit for it to spin up
-    targetTBH(robot.flywheel, 2500);
+    // Target flywheel early so we don't have to waste time waiit for it to spin up, tracking the high flag as we drive
+    aimFlywheel(FLAG_HIGH);
 
     // Om nom nom balls (intake mode)
     robot.intake = REVERSE;
@@ -280,7 +383,7 @@ void autonFrontfield() {
     drive(-650);
 
     wait1Msec(200);
-    drive(100)
+    drive(100);
     // Turn to face tree of flags
     if(match.alliance == ALLIANCE_RED) {
         turn(100);
@@ -291,6 +394,9 @@ void autonFrontfield() {
     // First first shot
     fire();
 
+    // Hold the speed we shot at
+    aimFlywheel(-1);
+
     // wait1Msec(300);
     // // set rpm for secound shot
     // // targetTBH(robot.flywheel, 2500);
@@ -344,7 +450,7 @@ void autonProgSkills() {
 
     wait1Msec(1000);
 
-    driveMax(2000)
+    driveMax(2000);
 
 }
 
@@ -359,13 +465,13 @@ void autonBlake() {
     turn(71);
 
 
-    wait1Msec(1000)
+    wait1Msec(1000);
 
 
     fire();
 
     targetTBH(robot.flywheel, 2600);
-    wait1Msec(4000)
+    wait1Msec(4000);
     fire();
     
 
@@ -381,10 +487,10 @@ void autonTestFlywheel() {
 }
 
 void autonDoubleShot()  {
-    doubleShot(2500, 2000)
+    doubleShot(2500, 2000);
 }
 
 void autonTestDrive() {
-    targetTBH(robot.flywheel, 2500)
+    targetTBH(robot.flywheel, 2500);
     drive(600);
 }
\ No newline at end of file
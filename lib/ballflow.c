@@ -0,0 +1,159 @@
+/**
+ * ballflow.c - Ball flow and shot cadence
+ *
+ * Follows each ball from the intake to the flywheel, and charges every HAL cycle to whatever the next shot was
+ * waiting on:
+ *  Intake    No ball at the detector yet (intake and indexer speed)
+ *  Sonar     Ball at the detector, but not confirmed by the filter yet (from the filter's measured latency)
+ *  Flywheel  Ball loaded, flywheel not ready (spin up or recovery)
+ *  Command   Ball loaded, flywheel ready, but nothing has asked to fire
+ *  Feed      Indexer pushing the ball into the flywheel
+ *  Reset     Double shot still timing out after its second ball has gone
+ *
+ * Each shot closes its ball's record and logs where it waited. Over a run, the totals show which subsystem limits
+ * cadence, and balls per second is the number to beat. Reset between runs. tools/sim.py runs it against simulated
+ * balls, with tunables changed for what-ifs.
+ *
+ * Only bursts of shooting are measured. In driver control the robot spends most of its time not shooting, and that
+ * time would otherwise pile up in the intake and command stages. A shot more than FLOW_BURST_GAP after the one before
+ * it starts a new burst. Its ball waited on the driver rather than on the robot, so its record is dropped, and
+ * balls per second only counts the time within bursts.
+ *
+ * The indexer is judged from motorTarget, which is what the motor is actually doing this cycle. That is one cycle
+ * behind the HAL's decision to fire (takerStep applies it on the next cycle), so that cycle counts as command,
+ * not feed.
+ */
+
+#pragma systemFile
+
+#include "util.c"
+
+#define FLOW_INTAKE 0
+#define FLOW_SONAR 1
+#define FLOW_FLYWHEEL 2
+#define FLOW_COMMAND 3
+#define FLOW_FEED 4
+#define FLOW_RESET 5
+#define FLOW_STAGES 6
+
+#define FLOW_BURST_GAP 3000 // ms without a shot that ends a burst
+
+typedef struct {
+    long ball[FLOW_STAGES];  // ms the ball on its way has waited in each stage
+    long total[FLOW_STAGES]; // ms across every timed shot
+    int shots;
+    int timed;      // Shots with their waits in total (all but the first of each burst after an idle gap)
+    int bursts;
+    long burstTime; // ms between the first and last shot of each burst, summed
+    long lastShot;  // 0 before the first shot
+    long lastTime;
+    bool wasLoaded;
+    bool wasFeeding;
+} BallFlow;
+
+BallFlow flow;
+
+string flowStageNames[FLOW_STAGES] = { "intake", "sonar", "flywheel", "command", "feed", "reset" };
+
+void resetFlow() {
+    for(int i = 0; i < FLOW_STAGES; i++) {
+        flow.ball[i] = 0;
+        flow.total[i] = 0;
+    }
+
+    flow.shots = 0;
+    flow.timed = 0;
+    flow.bursts = 0;
+    flow.burstTime = 0;
+    flow.lastShot = 0;
+    flow.lastTime = nSysTime;
+}
+
+void flowShot() {
+    bool idle = flow.lastShot != 0 && nSysTime - flow.lastShot > FLOW_BURST_GAP;
+
+    flow.shots++;
+    if (flow.lastShot == 0 || idle) {
+        flow.bursts++;
+    } else {
+        flow.burstTime += nSysTime - flow.lastShot;
+    }
+    flow.lastShot = nSysTime;
+
+    writeDebugStreamLine("ball %d: %d,%d,%d,%d,%d,%d%s", flow.shots, flow.ball[FLOW_INTAKE], flow.ball[FLOW_SONAR],
+        flow.ball[FLOW_FLYWHEEL], flow.ball[FLOW_COMMAND], flow.ball[FLOW_FEED], flow.ball[FLOW_RESET],
+        idle ? " (idle, not counted)" : "");
+
+    if (!idle) flow.timed++;
+
+    for(int i = 0; i < FLOW_STAGES; i++) {
+        if (!idle) flow.total[i] += flow.ball[i];
+        flow.ball[i] = 0;
+    }
+}
+
+/**
+ * Call every HAL cycle
+ * @param bool loaded Whether the detector (filtered) sees a ball
+ * @param bool feeding Whether the indexer is pushing toward the flywheel this cycle
+ * @param bool ready Whether the flywheel is ready to fire
+ * @param bool resetting Whether a double shot is waiting out its reset
+ * @param int sonarLatency ms the sonar filter took to follow its last change
+ */
+void flowStep(bool loaded, bool feeding, bool ready, bool resetting, int sonarLatency) {
+    int dt = clamp(nSysTime - flow.lastTime, 0, 100);
+    flow.lastTime = nSysTime;
+
+    // The ball reached the detector before the filter said so
+    if (loaded && !flow.wasLoaded) {
+        int latency = clamp(sonarLatency, 0, flow.ball[FLOW_INTAKE]);
+        flow.ball[FLOW_INTAKE] -= latency;
+        flow.ball[FLOW_SONAR] += latency;
+    }
+
+    // Leaving the detector while being fed is a shot
+    if (!loaded && flow.wasLoaded && flow.wasFeeding) {
+        flowShot();
+    }
+
+    int stage;
+    if (!loaded) {
+        stage = resetting ? FLOW_RESET : FLOW_INTAKE;
+    } else if (feeding) {
+        stage = FLOW_FEED;
+    } else if (!ready) {
+        stage = FLOW_FLYWHEEL;
+    } else {
+        stage = FLOW_COMMAND;
+    }
+    flow.ball[stage] += dt;
+
+    flow.wasLoaded = loaded;
+    flow.wasFeeding = feeding;
+}
+
+/**
+ * @return float Balls per second within bursts
+ */
+float flowRate() {
+    if (flow.burstTime == 0) return 0;
+    return (flow.shots - flow.bursts) * 1000.0 / flow.burstTime;
+}
+
+/**
+ * @return int Average ms each timed ball waited in a stage
+ */
+int flowAverage(int stage) {
+    return flow.timed > 0 ? flow.total[stage] / flow.timed : 0;
+}
+
+/**
+ * Logs the run so far to the debug stream
+ */
+void flowReport() {
+    writeDebugStreamLine("Flow: %d shots in %d bursts, %.2f balls/s", flow.shots, flow.bursts, flowRate());
+
+    for(int i = 0; i < FLOW_STAGES; i++) {
+        writeDebugStreamLine("  %s: %d ms/ball", flowStageNames[i], flowAverage(i));
+    }
+}
@@ -0,0 +1,56 @@
+/**
+ * ballistics.c - Flywheel RPM from distance to the flags
+ *
+ * RPM for each flag height is measured at a handful of distances, and interpolated in between, so the flywheel
+ * can be brought to the right speed while the robot is still driving to where it will shoot from.
+ */
+
+#pragma systemFile
+
+#include "odometry.c"
+
+#define FLAG_HIGH 0
+#define FLAG_MIDDLE 1
+
+#define BALLISTICS_POINTS 6
+
+// Distance (inches) from the flag column
+float ballisticsDistance[BALLISTICS_POINTS] = { 24, 36, 48, 72, 96, 120 };
+
+// RPM to hit each flag at each distance. Seeded from the presets we already shoot with, measure to refine
+int ballisticsRPM[2][BALLISTICS_POINTS] = {
+    { 2400, 2450, 2500, 2600, 2800, 2900 }, // FLAG_HIGH
+    { 2000, 2050, 2150, 2300, 2450, 2600 }  // FLAG_MIDDLE
+};
+
+// Where the flag column is, relative to the front starting tile (RED, BLUE). The field is mirrored, so only y changes
+float ballisticsTargetX = 6;
+float ballisticsTargetY[2] = { 96, -96 };
+
+// Which side's flags to aim at (0 = RED, 1 = BLUE, set from the match configuration when aiming starts)
+int ballisticsAlliance = 0;
+
+/**
+ * Interpolates the RPM for a flag at a distance (clamped to the ends of the table)
+ * @param int flag FLAG_HIGH or FLAG_MIDDLE
+ * @param float distance Distance from the flag column, inches
+ */
+int ballisticsLookup(int flag, float distance) {
+    if (distance <= ballisticsDistance[0]) return ballisticsRPM[flag][0];
+
+    for(int i = 1; i < BALLISTICS_POINTS; i++) {
+        if (distance <= ballisticsDistance[i]) {
+            float t = (distance - ballisticsDistance[i - 1]) / (ballisticsDistance[i] - ballisticsDistance[i - 1]);
+            return ballisticsRPM[flag][i - 1] + t * (ballisticsRPM[flag][i] - ballisticsRPM[flag][i - 1]);
+        }
+    }
+
+    return ballisticsRPM[flag][BALLISTICS_POINTS - 1];
+}
+
+/**
+ * RPM for a flag from where the robot is now
+ */
+int ballisticsForPose(Odometry & odometry, int flag) {
+    return ballisticsLookup(flag, odometryDistanceTo(odometry, ballisticsTargetX, ballisticsTargetY[ballisticsAlliance]));
+}
@@ -0,0 +1,473 @@
+/**
+ * console.c - Live tuning console on UART2
+ *
+ * Line based, one command per line:
+ *  list                  Prints every parameter
+ *  get <name>            Prints a parameter
+ *  set <name> <value>    Changes a parameter, if the value is in its range (consoleParamMin/Max)
+ *  slew <port> [value]   Prints or changes a motor's slew rate (power per ms)
+ *  spin <rpm>            Targets the flywheel
+ *  fire                  Fires a ball
+ *  stream <hz>           Streams binary telemetry (see telemetry.c), 0 to stop
+ *  metrics               Prints flywheel metrics against their baselines (see metrics.c)
+ *  mem                   Prints the size of the big globals against their budgets (see memory.c)
+ *  enc                   Prints encoder health: fault/failures/healthy (see encoder.c)
+ *  flow [reset]          Prints balls per second and where each ball waited on average, ms (see ballflow.c)
+ *  sched                 Prints the flywheel gain schedule and hold voltages, as commands that load them back
+ *  sched <cell> <ki> <bang>  Loads a gain schedule cell (see tbhschedule.c)
+ *  hold <bin> <volts>    Loads a flywheel hold voltage (see feedforward.c)
+ *  sysid <lin|ang>       Identifies the drive model (see sysid.c), needs clear space and driver control
+ *
+ * Input is read without blocking and parsed in place, so the console doesn't allocate or copy anything
+ **/
+
+#pragma systemFile
+
+#include "../hal.c"
+#include "auton.c"
+#include "mode.c"
+#include "telemetry.c"
+#include "memory.c"
+
+#define CONSOLE_PORT uartTwo
+#define CONSOLE_LINE_SIZE 48
+#define CONSOLE_PERIOD 20
+
+enum consoleParam {
+    PARAM_FLY_KI = 0,
+    PARAM_FLY_BANG = 1,
+    PARAM_FLY_HOLD = 2,
+    PARAM_PRESET_U = 3,
+    PARAM_PRESET_R = 4,
+    PARAM_PRESET_L = 5,
+    PARAM_FIRE_ERROR = 6,
+    PARAM_FIRE_MIN = 7,
+    PARAM_DRIVE_KP = 8,
+    PARAM_TURN_KP = 9,
+    PARAM_DRIVER_RPM = 10,
+    PARAM_TRACTION = 11,
+    PARAM_TRACTION_ACCEL = 12,
+    PARAM_TRACTION_SLIP = 13,
+    PARAM_AUTO_FLAG = 14,
+    PARAM_GYRO_SCALE = 15,
+    PARAM_LIN_KS = 16,
+    PARAM_LIN_KV = 17,
+    PARAM_LIN_KA = 18,
+    PARAM_ANG_KS = 19,
+    PARAM_ANG_KV = 20,
+    PARAM_ANG_KA = 21,
+    PARAM_FLY_SCHED = 22,
+    PARAM_FLY_LEARN = 23,
+    PARAM_INDEXER_POWER = 24,
+    PARAM_DOUBLE_RESET = 25,
+    PARAM_COUNT = 26
+};
+
+// Names, in consoleParam order
+string consoleParamNames[PARAM_COUNT] = {
+    "fly_ki", "fly_bang", "fly_hold",
+    "preset_u", "preset_r", "preset_l",
+    "fire_err", "fire_min",
+    "drive_kp", "turn_kp",
+    "driver_rpm",
+    "traction", "trac_accel", "trac_slip",
+    "auto_flag", "gyro_scale",
+    "lin_ks", "lin_kv", "lin_ka",
+    "ang_ks", "ang_kv", "ang_ka",
+    "fly_sched", "fly_learn",
+    "index_pwr", "dbl_reset"
+};
+
+// Accepted range of each parameter, in consoleParam order, so a typo (a negative gain, a preset the flywheel can't
+// reach) is turned away instead of reaching the robot
+float consoleParamMin[PARAM_COUNT] = {
+    0, 0, 0,
+    0, 0, 0,
+    0, 0,
+    0, 0,
+    0,
+    0, 0, 0,
+    -1, 0.5,
+    0, 0, 0,
+    0, 0, 0,
+    0, 0,
+    0, 0
+};
+float consoleParamMax[PARAM_COUNT] = {
+    0.01, ROBOT_FLYWHEEL_MAX_RPM, 127,
+    ROBOT_FLYWHEEL_MAX_RPM, ROBOT_FLYWHEEL_MAX_RPM, ROBOT_FLYWHEEL_MAX_RPM,
+    1000, ROBOT_FLYWHEEL_MAX_RPM,
+    10, 10,
+    ROBOT_FLYWHEEL_MAX_RPM,
+    1, MOTOR_SLEW_NONE, 127,
+    FLAG_MIDDLE, 1.5,
+    12, 1, 1,
+    12, 1, 1,
+    1, 1,
+    127, 5000
+};
+
+char consoleLine[CONSOLE_LINE_SIZE];
+int consoleLength = 0;
+
+// Reply being built (see consoleWrite)
+char consoleOut[CONSOLE_LINE_SIZE];
+int consoleOutLength = 0;
+
+// Shared by everything that formats a reply (only the console task uses it)
+string consoleScratch;
+bool consoleRunning = false;
+
+float consoleGet(int param) {
+    switch(param) {
+        case PARAM_FLY_KI: return robot.flywheel.Ki;
+        case PARAM_FLY_BANG: return robot.flywheel.bangBang;
+        case PARAM_FLY_HOLD: return doubleShotHold;
+        case PARAM_PRESET_U: return flywheelPresets[0];
+        case PARAM_PRESET_R: return flywheelPresets[1];
+        case PARAM_PRESET_L: return flywheelPresets[2];
+        case PARAM_FIRE_ERROR: return fireMaxError;
+        case PARAM_FIRE_MIN: return fireMinSetpoint;
+        case PARAM_DRIVE_KP: return driveKp;
+        case PARAM_TURN_KP: return turnKp;
+        case PARAM_DRIVER_RPM: return driverStartRPM;
+        case PARAM_TRACTION: return leftTraction.enabled;
+        case PARAM_TRACTION_ACCEL: return leftTraction.maxAccel;
+        case PARAM_TRACTION_SLIP: return leftTraction.slipMargin;
+        case PARAM_AUTO_FLAG: return robot.flywheelAutoFlag;
+        case PARAM_GYRO_SCALE: return robot.heading.scale;
+        case PARAM_LIN_KS: return linearModel.kS;
+        case PARAM_LIN_KV: return linearModel.kV;
+        case PARAM_LIN_KA: return linearModel.kA;
+        case PARAM_ANG_KS: return angularModel.kS;
+        case PARAM_ANG_KV: return angularModel.kV;
+        case PARAM_ANG_KA: return angularModel.kA;
+        case PARAM_FLY_SCHED: return flywheelSchedule.enabled;
+        case PARAM_FLY_LEARN: return flywheelSchedule.learning;
+        case PARAM_INDEXER_POWER: return indexerPower;
+        case PARAM_DOUBLE_RESET: return doubleShotReset;
+    }
+    return 0;
+}
+
+void consoleSet(int param, float value) {
+    switch(param) {
+        // With the schedule on, these flatten its table (otherwise the schedule would just overwrite them)
+        case PARAM_FLY_KI: robot.flywheel.Ki = value; scheduleFill(flywheelSchedule, false, value); break;
+        case PARAM_FLY_BANG: robot.flywheel.bangBang = value; scheduleFill(flywheelSchedule, true, value); break;
+        case PARAM_FLY_HOLD: doubleShotHold = value; break;
+        case PARAM_PRESET_U: flywheelPresets[0] = value; break;
+        case PARAM_PRESET_R: flywheelPresets[1] = value; break;
+        case PARAM_PRESET_L: flywheelPresets[2] = value; break;
+        case PARAM_FIRE_ERROR: fireMaxError = value; break;
+        case PARAM_FIRE_MIN: fireMinSetpoint = value; break;
+        case PARAM_DRIVE_KP: driveKp = value; break;
+        case PARAM_TURN_KP: turnKp = value; break;
+        case PARAM_DRIVER_RPM: driverStartRPM = value; break;
+        case PARAM_TRACTION: leftTraction.enabled = rightTraction.enabled = value != 0; break;
+        case PARAM_TRACTION_ACCEL: leftTraction.maxAccel = rightTraction.maxAccel = value; break;
+        case PARAM_TRACTION_SLIP: leftTraction.slipMargin = rightTraction.slipMargin = value; break;
+        case PARAM_AUTO_FLAG: aimFlywheel(value); break;
+        case PARAM_GYRO_SCALE: robot.heading.scale = value; break;
+        case PARAM_LIN_KS: linearModel.kS = value; break;
+        case PARAM_LIN_KV: linearModel.kV = value; break;
+        case PARAM_LIN_KA: linearModel.kA = value; break;
+        case PARAM_ANG_KS: angularModel.kS = value; break;
+        case PARAM_ANG_KV: angularModel.kV = value; break;
+        case PARAM_ANG_KA: angularModel.kA = value; break;
+        case PARAM_FLY_SCHED: flywheelSchedule.enabled = value != 0; break;
+        case PARAM_FLY_LEARN: flywheelSchedule.learning = value != 0; break;
+        case PARAM_INDEXER_POWER: indexerPower = value; break;
+        case PARAM_DOUBLE_RESET: doubleShotReset = value; break;
+    }
+}
+
+/**
+ * @return bool Whether a value is inside a parameter's range
+ **/
+bool consoleInRange(int param, float value) {
+    return value >= consoleParamMin[param] && value <= consoleParamMax[param];
+}
+
+/**
+ * Adds text to the reply line, which goes out on consoleWriteLine
+ **/
+void consoleWrite(char * text) {
+    for(int i = 0; text[i] != 0 && consoleOutLength < CONSOLE_LINE_SIZE; i++) {
+        consoleOut[consoleOutLength++] = text[i];
+    }
+}
+
+/**
+ * Finishes the reply line and sends it: as a text frame while telemetry is streaming, so it can't corrupt a frame,
+ * otherwise as plain text
+ **/
+void consoleWriteLine(char * text) {
+    consoleWrite(text);
+
+    if (telemetryStreaming()) {
+        telemetrySendText(consoleOut, consoleOutLength);
+    } else {
+        telemetryLockPort();
+        for(int i = 0; i < consoleOutLength; i++) {
+            sendChar(CONSOLE_PORT, consoleOut[i]);
+        }
+        sendChar(CONSOLE_PORT, '\r');
+        sendChar(CONSOLE_PORT, '\n');
+        telemetryUnlockPort();
+    }
+
+    consoleOutLength = 0;
+}
+
+void consolePrintParam(int param) {
+    consoleWrite(consoleParamNames[param]);
+    sprintf(consoleScratch, "=%1.5f", consoleGet(param));
+    consoleWriteLine(consoleScratch);
+}
+
+/**
+ * Looks up a parameter by name
+ * @return int The parameter, or -1 if there is no parameter with that name
+ **/
+int consoleFindParam(char * buffer, int start, int length) {
+    for(int i = 0; i < PARAM_COUNT; i++) {
+        if (tokenEquals(buffer, start, length, consoleParamNames[i])) return i;
+    }
+    return -1;
+}
+
+/**
+ * Runs a single command line
+ **/
+void consoleExecute(char * line) {
+    int position = 0;
+    int start, length;
+    int argStart, argLength;
+    float value;
+
+    length = nextToken(line, position, start, ' ');
+    if (length == 0) return;
+
+    if (tokenEquals(line, start, length, "list")) {
+        for(int i = 0; i < PARAM_COUNT; i++) consolePrintParam(i);
+
+    } else if (tokenEquals(line, start, length, "get") || tokenEquals(line, start, length, "set")) {
+        bool set = line[start] == 's';
+        int param;
+
+        argLength = nextToken(line, position, argStart, ' ');
+        param = consoleFindParam(line, argStart, argLength);
+        if (param < 0) {
+            consoleWriteLine("ERR unknown parameter");
+            return;
+        }
+
+        if (set) {
+            argLength = nextToken(line, position, argStart, ' ');
+            if (!tokenToFloat(line, argStart, argLength, value)) {
+                consoleWriteLine("ERR bad value");
+                return;
+            }
+            if (!consoleInRange(param, value)) {
+                consoleWriteLine("ERR out of range");
+                return;
+            }
+            consoleSet(param, value);
+        }
+        consolePrintParam(param);
+
+    } else if (tokenEquals(line, start, length, "slew")) {
+        int port;
+
+        argLength = nextToken(line, position, argStart, ' ');
+        if (!tokenToFloat(line, argStart, argLength, value) || value < 1 || value > 10) {
+            consoleWriteLine("ERR bad port");
+            return;
+        }
+        port = value - 1;
+
+        argLength = nextToken(line, position, argStart, ' ');
+        if (argLength > 0) {
+            if (!tokenToFloat(line, argStart, argLength, value)) {
+                consoleWriteLine("ERR bad value");
+                return;
+            }
+            motorSlew[port] = value;
+        }
+
+        sprintf(consoleScratch, "slew%d=%1.3f", port + 1, motorSlew[port]);
+        consoleWriteLine(consoleScratch);
+
+    } else if (tokenEquals(line, start, length, "spin")) {
+        argLength = nextToken(line, position, argStart, ' ');
+        if (!tokenToFloat(line, argStart, argLength, value) || value < 0 || value > robot.flywheel.maxRPM) {
+            consoleWriteLine("ERR bad rpm");
+            return;
+        }
+        targetTBH(robot.flywheel, value);
+        consoleWriteLine("OK");
+
+    } else if (tokenEquals(line, start, length, "stream")) {
+        argLength = nextToken(line, position, argStart, ' ');
+        if (!tokenToFloat(line, argStart, argLength, value) || value < 0) {
+            consoleWriteLine("ERR bad rate");
+            return;
+        }
+        telemetryStream(value);
+        consoleWriteLine("OK");
+
+    } else if (tokenEquals(line, start, length, "metrics")) {
+        for(int i = 0; i < METRIC_COUNT; i++) {
+            // metric: last/best/baseline (strings are only 20 characters)
+            sprintf(consoleScratch, "%d:%d/%d/%d", i, metrics.last[i], metrics.best[i], metrics.baseline[i]);
+            consoleWriteLine(consoleScratch);
+        }
+        sprintf(consoleScratch, "shots %d regr %d", metrics.shots, metrics.regressions);
+        consoleWriteLine(consoleScratch);
+
+    } else if (tokenEquals(line, start, length, "mem")) {
+        memoryMeasure();
+        for(int i = 0; i < MEMORY_ITEMS; i++) {
+            consoleWrite(memoryNames[i]);
+            sprintf(consoleScratch, " %d/%d", memorySize[i], memoryBudget[i]);
+            consoleWriteLine(consoleScratch);
+        }
+
+    } else if (tokenEquals(line, start, length, "enc")) {
+        // flywheel, left, right: fault/failures/healthy
+        sprintf(consoleScratch, "F %d/%d/%d", flywheelEncoder.fault, flywheelEncoder.faults, flywheelEncoder.healthy);
+        consoleWriteLine(consoleScratch);
+        sprintf(consoleScratch, "L %d/%d/%d", leftEncoder.fault, leftEncoder.faults, leftEncoder.healthy);
+        consoleWriteLine(consoleScratch);
+        sprintf(consoleScratch, "R %d/%d/%d", rightEncoder.fault, rightEncoder.faults, rightEncoder.healthy);
+        consoleWriteLine(consoleScratch);
+
+    } else if (tokenEquals(line, start, length, "flow")) {
+        argLength = nextToken(line, position, argStart, ' ');
+        if (tokenEquals(line, argStart, argLength, "reset")) {
+            resetFlow();
+            consoleWriteLine("OK");
+            return;
+        }
+
+        sprintf(consoleScratch, "%d shots %.2f/s", flow.shots, flowRate());
+        consoleWriteLine(consoleScratch);
+        for(int i = 0; i < FLOW_STAGES; i++) {
+            consoleWrite(flowStageNames[i]);
+            sprintf(consoleScratch, " %d", flowAverage(i));
+            consoleWriteLine(consoleScratch);
+        }
+
+    } else if (tokenEquals(line, start, length, "sched")) {
+        float ki, bang;
+        argLength = nextToken(line, position, argStart, ' ');
+
+        // No arguments: export
+        if (argLength == 0) {
+            for(int i = 0; i < SCHEDULE_CELLS; i++) {
+                sprintf(consoleScratch, "sched %d ", i);
+                consoleWrite(consoleScratch);
+                sprintf(consoleScratch, "%1.5f ", flywheelSchedule.Ki[i]);
+                consoleWrite(consoleScratch);
+                sprintf(consoleScratch, "%d", (int)flywheelSchedule.bangBang[i]);
+                consoleWriteLine(consoleScratch);
+            }
+            for(int i = 0; i < FEEDFORWARD_BINS; i++) {
+                sprintf(consoleScratch, "hold %d %1.3f", i, flywheelHold.power[i]);
+                consoleWriteLine(consoleScratch);
+            }
+            return;
+        }
+
+        if (!tokenToFloat(line, argStart, argLength, value) || value < 0 || value >= SCHEDULE_CELLS) {
+            consoleWriteLine("ERR bad cell");
+            return;
+        }
+        argLength = nextToken(line, position, argStart, ' ');
+        if (!tokenToFloat(line, argStart, argLength, ki) || !consoleInRange(PARAM_FLY_KI, ki)) {
+            consoleWriteLine("ERR bad ki");
+            return;
+        }
+        argLength = nextToken(line, position, argStart, ' ');
+        if (!tokenToFloat(line, argStart, argLength, bang) || !consoleInRange(PARAM_FLY_BANG, bang)) {
+            consoleWriteLine("ERR bad bang");
+            return;
+        }
+        flywheelSchedule.Ki[(int)value] = ki;
+        flywheelSchedule.bangBang[(int)value] = bang;
+        consoleWriteLine("OK");
+
+    } else if (tokenEquals(line, start, length, "hold")) {
+        float volts;
+        argLength = nextToken(line, position, argStart, ' ');
+        if (!tokenToFloat(line, argStart, argLength, value) || value < 0 || value >= FEEDFORWARD_BINS) {
+            consoleWriteLine("ERR bad bin");
+            return;
+        }
+        argLength = nextToken(line, position, argStart, ' ');
+        if (!tokenToFloat(line, argStart, argLength, volts) || volts < 0 || volts > 12) {
+            consoleWriteLine("ERR bad volts");
+            return;
+        }
+        flywheelHold.power[(int)value] = volts;
+        consoleWriteLine("OK");
+
+    } else if (tokenEquals(line, start, length, "sysid")) {
+        argLength = nextToken(line, position, argStart, ' ');
+        if (!tokenEquals(line, argStart, argLength, "lin") && !tokenEquals(line, argStart, argLength, "ang")) {
+            consoleWriteLine("ERR lin or ang");
+            return;
+        }
+        if (!sysidStart(line[argStart] == 'a' ? SYSID_ANGULAR : SYSID_LINEAR)) {
+            consoleWriteLine("ERR busy or disabled");
+            return;
+        }
+        consoleWriteLine("OK");
+
+    } else if (tokenEquals(line, start, length, "fire")) {
+        robot.firing = true;
+        consoleWriteLine("OK");
+
+    } else {
+        consoleWriteLine("ERR unknown command");
+    }
+}
+
+/**
+ * Runs whatever lines have arrived, without waiting for more
+ **/
+void consolePoll() {
+    int c;
+
+    while((c = getChar(CONSOLE_PORT)) >= 0) {
+        if (c == '\r' || c == '\n') {
+            consoleLine[consoleLength] = 0;
+            consoleExecute(consoleLine);
+            consoleLength = 0;
+        } else if (consoleLength < CONSOLE_LINE_SIZE - 1) {
+            consoleLine[consoleLength++] = c;
+        }
+    }
+}
+
+task serialConsole() {
+    while(true) {
+        profileBegin(PROFILE_CONSOLE);
+        consolePoll();
+        profileEnd(PROFILE_CONSOLE);
+
+        wait1Msec(CONSOLE_PERIOD);
+    }
+}
+
+/**
+ * Starts the console if it isn't already running
+ **/
+void consoleStart() {
+    if (consoleRunning) return;
+
+    consoleRunning = true;
+    telemetryInit();
+    startTask(serialConsole);
+}
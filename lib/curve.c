@@ -0,0 +1,118 @@
+/**
+ * curve.c - Drive response curves
+ *
+ * Joystick input is mapped through a 128 entry table, generated from a profile when a driver is selected
+ * (rather than pasted in by hand), so that every curve is monotonic, has a clean deadzone, and reaches 127.
+ *
+ * Past the deadzone, the input is normalized to x (0 - 1) and the output is minimum + (127 - minimum) * f(x):
+ *  CURVE_LOGISTIC  f is an S-curve, shape is the steepness
+ *  CURVE_EXPO      f = x ^ shape
+ *  CURVE_CUBIC     f = shape * x^3 + (1 - shape) * x
+ *  CURVE_PIECEWISE Two straight lines through (shape, knee / 127)
+ */
+
+#pragma systemFile
+
+#include "util.c"
+
+enum curveType {
+    CURVE_LOGISTIC = 0,
+    CURVE_EXPO = 1,
+    CURVE_CUBIC = 2,
+    CURVE_PIECEWISE = 3
+};
+
+typedef struct {
+    curveType type;
+    int deadzone; // Inputs at or below this give 0
+    int minimum;  // Output just past the deadzone (enough to overcome friction)
+    float shape;  // See above
+    int knee;     // CURVE_PIECEWISE only
+} CurveProfile;
+
+#define DRIVER_PROFILE_COUNT 4
+
+CurveProfile driverProfiles[DRIVER_PROFILE_COUNT];
+string driverProfileNames[DRIVER_PROFILE_COUNT] = { "Logistic", "Expo", "Cubic", "Precision" };
+int driverProfile = 0;
+
+// The active curve
+int driveCurve[128];
+
+/**
+ * Evaluates f(x) for a profile (see above)
+ */
+float curveShape(CurveProfile & profile, float x) {
+    switch(profile.type) {
+        case CURVE_LOGISTIC: {
+            // Rescaled so that f(0) = 0 and f(1) = 1
+            float low = 1 / (1 + exp(profile.shape * 0.5));
+            float high = 1 / (1 + exp(-profile.shape * 0.5));
+            return (1 / (1 + exp(-profile.shape * (x - 0.5))) - low) / (high - low);
+        }
+        case CURVE_EXPO:
+            return pow(x, profile.shape);
+        case CURVE_CUBIC:
+            return profile.shape * x * x * x + (1 - profile.shape) * x;
+        case CURVE_PIECEWISE: {
+            float kneeOut = profile.knee / 127.0;
+            if (x <= profile.shape) return x * kneeOut / profile.shape;
+            return kneeOut + (x - profile.shape) * (1 - kneeOut) / (1 - profile.shape);
+        }
+    }
+    return x;
+}
+
+/**
+ * Fills a table from a profile
+ * @param int * table 128 entries, indexed by the magnitude of the input
+ */
+void generateCurve(int * table, CurveProfile & profile) {
+    table[0] = 0;
+
+    for(int n = 1; n < 128; n++) {
+        if (n <= profile.deadzone) {
+            table[n] = 0;
+        } else {
+            float x = (float)(n - profile.deadzone) / (127 - profile.deadzone);
+            table[n] = round(profile.minimum + (127 - profile.minimum) * clamp(curveShape(profile, x), 0, 1));
+        }
+    }
+}
+
+void initDriverProfiles() {
+    // Same deadzone and minimum as the old hand-made table, without the jump at the top
+    driverProfiles[0].type = CURVE_LOGISTIC;
+    driverProfiles[0].deadzone = 16;
+    driverProfiles[0].minimum = 25;
+    driverProfiles[0].shape = 6;
+
+    driverProfiles[1].type = CURVE_EXPO;
+    driverProfiles[1].deadzone = 10;
+    driverProfiles[1].minimum = 20;
+    driverProfiles[1].shape = 2;
+
+    driverProfiles[2].type = CURVE_CUBIC;
+    driverProfiles[2].deadzone = 10;
+    driverProfiles[2].minimum = 20;
+    driverProfiles[2].shape = 0.6;
+
+    // Slow and fine for most of the stick, then full power
+    driverProfiles[3].type = CURVE_PIECEWISE;
+    driverProfiles[3].deadzone = 10;
+    driverProfiles[3].minimum = 20;
+    driverProfiles[3].shape = 0.7;
+    driverProfiles[3].knee = 50;
+}
+
+void useDriverProfile(int profile) {
+    driverProfile = clamp(profile, 0, DRIVER_PROFILE_COUNT - 1);
+    generateCurve(driveCurve, driverProfiles[driverProfile]);
+}
+
+/**
+ * Maps joystick input through the active curve
+ */
+int curve(int n) {
+    return sgn(n) * driveCurve[(int)clamp(abs(n), 0, 127)];
+}
@@ -0,0 +1,189 @@
+/**
+ * encoder.c - Encoder health monitoring
+ *
+ * Watches an encoder against the power commanded to the mechanism it measures, and flags three kinds of failure:
+ *  - Stuck: no counts at all while the motor is clearly powered (unplugged or broken wire)
+ *  - Jump: more counts in one step than the mechanism could possibly turn (noise, or a reset from elsewhere)
+ *  - Reversed: a lost channel, which leaves a quad encoder counting one way whatever the command is
+ *
+ * A lost channel shows as counting against the command, but so does a mechanism that is being pushed, one whose
+ * command was just thrown the other way at speed, and a flywheel braked by bang-bang. So direction is only judged
+ * above minRate, where a count or two of jitter can't decide it, and the encoder is only reversed when it has
+ * counted against the command for reverseTime without slowing down (anything braking against the command slows
+ * down first), and hasn't counted the way the command is going for ENCODER_ONE_WAY_TIME (a robot pushed back has
+ * usually just driven forward, but a lost channel never counts that way at all).
+ *
+ * stepEncoder() returns the change to use in place of the raw change: jumps are dropped, and a reversed encoder is
+ * treated as single direction, with the direction taken from the command (see encoderDirect() in util.c), until it
+ * counts the other way with the command for reverseTime, which a lost channel can't do. A stuck encoder reports no
+ * change and is marked unhealthy, so the caller can fall back to something else. It becomes healthy again as soon as
+ * it counts with the command.
+ */
+
+#pragma systemFile
+
+#include "util.c"
+
+// Encoder faults
+#define ENCODER_OK 0
+#define ENCODER_STUCK 1
+#define ENCODER_JUMP 2
+#define ENCODER_REVERSED 3
+
+// ms without counting the commanded way at all before counting against it can be a lost channel
+#define ENCODER_ONE_WAY_TIME 5000
+
+// Counting against the command that has fallen below this share of where it started is slowing down
+#define ENCODER_SLOWING 0.9
+
+typedef struct {
+    long last;          // Last raw count
+    long position;      // Supervised count
+    long lastTime;
+
+    long lastMoved;     // nSysTime the encoder last counted (or wasn't expected to)
+    long counted[2];    // nSysTime the encoder last counted backwards [0] and forwards [1] above minRate
+    long opposedSince;  // nSysTime it started counting against the command above minRate, 0 if it isn't
+    float opposedRate;  // Counts per ms when it did
+    long recoverSince;  // Reversed: nSysTime it started counting the other way with the command, 0 if it isn't
+
+    float maxRate;      // Most counts per ms the mechanism can turn
+    float minRate;      // Counts per ms below which the direction isn't judged
+    int minPower;       // Power that should always turn the mechanism
+    int stuckTime;      // ms powered without a count before the encoder is stuck
+    int reverseTime;    // ms counting against the command before the encoder is reversed, and the other way to recover
+
+    int faults;         // Number of failures seen
+    ubyte fault;        // Current fault (ENCODER_*)
+    bool reversed;      // Running single direction
+    int reversedWay;    // The one way a reversed encoder counts (sgn)
+    bool healthy;
+} EncoderHealth;
+
+/**
+ * @param float maxRate Most counts per ms the mechanism can turn, anything faster is a glitch
+ * @param float minRate Counts per ms the direction is judged from, well above jitter
+ * @param int minPower Power that should always turn the mechanism
+ * @param int stuckTime ms at minPower without a count before the encoder is stuck
+ * @param int reverseTime ms counting against the command before the encoder is reversed, and the other way to recover
+ */
+void initEncoder(EncoderHealth & enc, float maxRate, float minRate, int minPower, int stuckTime, int reverseTime) {
+    enc.maxRate = maxRate;
+    enc.minRate = minRate;
+    enc.minPower = minPower;
+    enc.stuckTime = stuckTime;
+    enc.reverseTime = reverseTime;
+    enc.faults = 0;
+    enc.reversed = false;
+
+    // Not counted either way yet, which is as good as not for ENCODER_ONE_WAY_TIME
+    enc.counted[0] = nSysTime - ENCODER_ONE_WAY_TIME;
+    enc.counted[1] = nSysTime - ENCODER_ONE_WAY_TIME;
+}
+
+/**
+ * Restarts supervision from the given count, call whenever the encoder is zeroed
+ */
+void resetEncoder(EncoderHealth & enc, long value) {
+    enc.last = value;
+    enc.position = value;
+    enc.lastTime = nSysTime;
+    enc.lastMoved = nSysTime;
+    enc.opposedSince = 0;
+    enc.recoverSince = 0;
+    enc.fault = enc.reversed ? ENCODER_REVERSED : ENCODER_OK;
+    enc.healthy = true;
+}
+
+void encoderFault(EncoderHealth & enc, ubyte fault) {
+    if (enc.fault != fault) {
+        enc.faults++;
+        writeDebugStreamLine("Encoder fault %d (%d)", fault, enc.faults);
+    }
+    enc.fault = fault;
+}
+
+/**
+ * @param long value The raw encoder count
+ * @param int power The power commanded to the mechanism
+ * @return int The change in count to use
+ */
+int stepEncoder(EncoderHealth & enc, long value, int power) {
+    int dt = nSysTime - enc.lastTime;
+    int change = value - enc.last;
+
+    if (dt <= 0) {
+        return 0;
+    }
+
+    enc.lastTime = nSysTime;
+    enc.last = value;
+
+    bool powered = abs(power) >= enc.minPower;
+
+    // Jump: drop the reading, the next step measures from here
+    if (abs(change) > enc.maxRate * dt) {
+        encoderFault(enc, ENCODER_JUMP);
+        return 0;
+    }
+
+    // Stuck
+    if (change != 0 || !powered) {
+        enc.lastMoved = nSysTime;
+    }
+
+    if (nSysTime - enc.lastMoved > enc.stuckTime) {
+        encoderFault(enc, ENCODER_STUCK);
+        enc.healthy = false;
+        return 0;
+    }
+
+    // Direction, only above minRate
+    float rate = (float)abs(change) / dt;
+    int way = rate >= enc.minRate ? sgn(change) : 0;
+    if (way != 0) {
+        enc.counted[way > 0] = nSysTime;
+    }
+
+    if (!enc.reversed) {
+        if (!powered || way == 0 || way == sgn(power)) {
+            enc.opposedSince = 0;
+        } else if (enc.opposedSince == 0) {
+            enc.opposedSince = nSysTime;
+            enc.opposedRate = rate;
+        } else if (nSysTime - enc.opposedSince >= enc.reverseTime) {
+            if (rate >= enc.opposedRate * ENCODER_SLOWING &&
+                nSysTime - enc.counted[power > 0] > ENCODER_ONE_WAY_TIME) {
+                encoderFault(enc, ENCODER_REVERSED);
+                enc.reversed = true;
+                enc.reversedWay = way;
+                enc.recoverSince = 0;
+            } else {
+                // Braking, or just being pushed: judge again from here
+                enc.opposedSince = nSysTime;
+                enc.opposedRate = rate;
+            }
+        }
+    } else {
+        // Counting the other way with the command, which a lost channel can't
+        if (!powered || way != sgn(power) || way == enc.reversedWay) {
+            enc.recoverSince = 0;
+        } else if (enc.recoverSince == 0) {
+            enc.recoverSince = nSysTime;
+        } else if (nSysTime - enc.recoverSince >= enc.reverseTime) {
+            enc.reversed = false;
+            enc.opposedSince = 0;
+            writeDebugStreamLine("Encoder counting both ways again");
+        }
+    }
+
+    if (enc.reversed) {
+        change = encoderDirect(enc.position, enc.position + abs(change), power) - enc.position;
+    } else {
+        enc.fault = ENCODER_OK;
+    }
+
+    enc.healthy = true;
+    enc.position += change;
+    return change;
+}
@@ -0,0 +1,67 @@
+/**
+ * feedforward.c - Learned feed-forward table
+ *
+ * Maps a setpoint to the output (power, or volts) that holds it, by linear interpolation between evenly spaced bins. The table is
+ * seeded with a straight line, and refined online: whenever the closed loop controller has settled, the power it
+ * settled on is blended into the bins either side of the setpoint. It is what the flywheel falls back on when its
+ * encoder can't be trusted.
+ */
+
+#pragma systemFile
+
+#include "util.c"
+
+#define FEEDFORWARD_BINS 8
+
+typedef struct {
+    float power[FEEDFORWARD_BINS];
+    float step;         // Setpoint per bin
+    float rate;         // How much of each sample is blended in
+} FeedForward;
+
+/**
+ * @param float maxSetpoint The setpoint reached at full output, which the table spans
+ * @param float maxOutput Full output (the table starts as a straight line up to it)
+ * @param float rate How much of each sample is blended in (0 - 1)
+ */
+void initFeedForward(FeedForward & ff, float maxSetpoint, float maxOutput, float rate) {
+    ff.step = maxSetpoint / (FEEDFORWARD_BINS - 1);
+    ff.rate = rate;
+
+    for(int i = 0; i < FEEDFORWARD_BINS; i++) {
+        ff.power[i] = maxOutput * i / (FEEDFORWARD_BINS - 1);
+    }
+}
+
+/**
+ * @return float The power expected to hold the setpoint
+ */
+float feedForward(FeedForward & ff, float setpoint) {
+    if (setpoint <= 0) return 0;
+
+    float index = setpoint / ff.step;
+    int bin = index;
+
+    if (bin >= FEEDFORWARD_BINS - 1) return ff.power[FEEDFORWARD_BINS - 1];
+
+    float fraction = index - bin;
+    return ff.power[bin] * (1 - fraction) + ff.power[bin + 1] * fraction;
+}
+
+/**
+ * Blends in a power observed to hold the setpoint, shared between the neighbouring bins by how close each is
+ */
+void learnFeedForward(FeedForward & ff, float setpoint, float power) {
+    if (setpoint <= 0) return;
+
+    float index = setpoint / ff.step;
+    int bin = index;
+
+    if (bin >= FEEDFORWARD_BINS - 1) return;
+
+    float fraction = index - bin;
+    float error = power - feedForward(ff, setpoint);
+
+    ff.power[bin] += ff.rate * (1 - fraction) * error;
+    ff.power[bin + 1] += ff.rate * fraction * error;
+}
@@ -0,0 +1,146 @@
+/**
+ * heading.c - Continuous, drift-compensated heading from the gyro
+ *
+ * The raw gyro wraps every 3600 and drifts slowly. This unwraps it into a continuous angle, applies a measured
+ * scale factor (the gyro rarely reads exactly 360 for a full turn), and learns the drift rate whenever the robot
+ * is sitting still, subtracting it the rest of the time. The rotation implied by the drive encoders is tracked
+ * alongside, as a cross-check. The two are compared over each HEADING_CHECK_WINDOW: wheel scrub and an inexact
+ * track width make the encoders over or under count turns by some fraction, so the window is bad only if they
+ * disagree by more than that fraction (plus a little, for drift). After HEADING_SUSPECT_WINDOWS bad windows in a row
+ * the gyro is marked suspect and the heading follows the encoders, until HEADING_RECOVER_WINDOWS good windows in a
+ * row. While the gyro is trusted, the encoder angle is re-based to it after every window, so slip never adds up.
+ */
+
+#pragma systemFile
+
+#include "util.c"
+
+#define HEADING_STILL_TIME 500   // ms the robot must be still before drift is learned
+#define HEADING_BIAS_FILTER 0.02 // How quickly the drift estimate follows new measurements (0 - 1)
+#define HEADING_BIAS_MAX 0.05    // Largest believable drift, tenths of a degree per ms
+
+#define HEADING_CHECK_WINDOW 1000      // ms the gyro and encoders are compared over
+#define HEADING_DIVERGENCE_MIN 5       // Degrees they may always disagree by in a window
+#define HEADING_DIVERGENCE_SCALE 0.4   // Plus this fraction of the encoders' rotation (scrub, track width error)
+#define HEADING_SUSPECT_WINDOWS 2
+#define HEADING_RECOVER_WINDOWS 3
+
+typedef struct {
+    float angle; // Corrected heading, degrees counterclockwise, doesn't wrap
+
+    float scale; // Real degrees per gyro degree
+    float bias;  // Drift, tenths of a degree per ms
+
+    int lastReading;
+    long lastTime;
+    long stillSince;
+
+    // Cross-check
+    float degreesPerTick; // Rotation per tick of difference between the drive encoders
+    float encoderAngle;   // Rotation from the drive encoders, degrees (re-based to angle while the gyro is trusted)
+    long windowStart;
+    float windowGyro;     // Rotation in this window, from each
+    float windowEncoder;
+    int badWindows;       // In a row
+    int goodWindows;
+    bool gyroSuspect;     // The gyro disagrees with the encoders, heading is following the encoders instead
+} HeadingService;
+
+/**
+ * @param float scale Real degrees per gyro degree
+ * @param float degreesPerTick Rotation per tick of difference between the drive encoders (inches per tick over the
+ * track width, in degrees)
+ */
+void initHeading(HeadingService & heading, float scale, float degreesPerTick) {
+    heading.scale = scale;
+    heading.bias = 0;
+    heading.degreesPerTick = degreesPerTick;
+}
+
+/**
+ * Zeroes the heading. Call once the gyro is calibrated
+ */
+void resetHeading(HeadingService & heading, int reading) {
+    heading.angle = 0;
+    heading.encoderAngle = 0;
+    heading.windowStart = nSysTime;
+    heading.windowGyro = 0;
+    heading.windowEncoder = 0;
+    heading.badWindows = 0;
+    heading.goodWindows = 0;
+    heading.gyroSuspect = false;
+    heading.lastReading = reading;
+    heading.lastTime = nSysTime;
+    heading.stillSince = nSysTime;
+}
+
+/**
+ * @return float How far the gyro and encoder headings have drifted apart since the encoders were last re-based,
+ * degrees
+ */
+float headingDivergence(HeadingService & heading) {
+    return heading.angle - heading.encoderAngle;
+}
+
+/**
+ * @param int reading SensorValue of the gyro
+ * @param int leftTicks Left drive encoder change since the last step
+ * @param int rightTicks Right drive encoder change since the last step
+ * @param bool commanded Whether the drive is being driven
+ * @param bool encodersHealthy Whether both encoder changes were measured (not estimated from the other side)
+ * @return float The change in heading this step, degrees
+ */
+float stepHeading(HeadingService & heading, int reading, int leftTicks, int rightTicks, bool commanded, bool encodersHealthy) {
+    int dt = nSysTime - heading.lastTime;
+    heading.lastTime = nSysTime;
+    if (dt <= 0) return 0;
+
+    // The gyro wraps around every 3600, so take the shortest way round
+    int change = reading - heading.lastReading;
+    if (change > 1800) change -= 3600;
+    if (change < -1800) change += 3600;
+    heading.lastReading = reading;
+
+    // Learn the drift while nothing is moving
+    if (commanded || leftTicks != 0 || rightTicks != 0) {
+        heading.stillSince = nSysTime;
+    } else if (nSysTime - heading.stillSince > HEADING_STILL_TIME) {
+        heading.bias += HEADING_BIAS_FILTER * (clamp((float)change / dt, -HEADING_BIAS_MAX, HEADING_BIAS_MAX) - heading.bias);
+    }
+
+    float corrected = (change - heading.bias * dt) / 10.0 * heading.scale;
+    float encoderChange = (rightTicks - leftTicks) * heading.degreesPerTick;
+    heading.encoderAngle += encoderChange;
+    heading.windowGyro += corrected;
+    heading.windowEncoder += encoderChange;
+
+    // An estimated side can't vouch for the gyro either way
+    bool windowOver = nSysTime - heading.windowStart >= HEADING_CHECK_WINDOW;
+    if (!encodersHealthy) {
+        heading.badWindows = 0;
+        heading.goodWindows = 0;
+    } else if (windowOver) {
+        if (abs(heading.windowGyro - heading.windowEncoder) >
+            HEADING_DIVERGENCE_MIN + HEADING_DIVERGENCE_SCALE * abs(heading.windowEncoder)) {
+            heading.goodWindows = 0;
+            heading.badWindows++;
+            if (heading.badWindows >= HEADING_SUSPECT_WINDOWS) heading.gyroSuspect = true;
+        } else {
+            heading.badWindows = 0;
+            heading.goodWindows++;
+            if (heading.goodWindows >= HEADING_RECOVER_WINDOWS) heading.gyroSuspect = false;
+        }
+    }
+
+    if (heading.gyroSuspect) corrected = encoderChange;
+    heading.angle += corrected;
+
+    if (windowOver || !encodersHealthy) {
+        if (!heading.gyroSuspect) heading.encoderAngle = heading.angle;
+        heading.windowStart = nSysTime;
+        heading.windowGyro = 0;
+        heading.windowEncoder = 0;
+    }
+
+    return corrected;
+}
@@ -0,0 +1,91 @@
+/**
+ * jam.c - Stall detection and automatic unjamming for the intake and indexer
+ *
+ * Neither mechanism has an encoder, so a stall is inferred: the caller says when the mechanism is suspect (it
+ * is being driven, but the ball isn't going anywhere), and if that lasts for stallTime with no ball detector
+ * transition, the detector runs the motor backwards briefly and then forwards again to clear the ball.
+ * If the caller also sees the battery sagging (the motor pulling stall current), the time needed is halved.
+ */
+
+#pragma systemFile
+
+enum jamState {
+    JAM_NONE = 0,
+    JAM_REVERSE = 1,
+    JAM_FORWARD = 2
+};
+
+typedef struct {
+    // Tuning
+    int stallTime;    // ms a mechanism has to be suspect before it is considered jammed
+    int sagThreshold; // mV below the average battery level that suggests a stall (checked by the caller)
+    int reverseTime;  // ms to back the ball out
+    int forwardTime;  // ms to drive it forward again before detection restarts
+
+    jamState state;
+    long stateSince;
+    long suspectSince;
+    bool suspect;
+
+    int jams; // Number of unjam cycles run
+} JamDetector;
+
+void initJam(JamDetector & detector, int stallTime, int sagThreshold, int reverseTime, int forwardTime) {
+    detector.stallTime = stallTime;
+    detector.sagThreshold = sagThreshold;
+    detector.reverseTime = reverseTime;
+    detector.forwardTime = forwardTime;
+
+    detector.state = JAM_NONE;
+    detector.stateSince = nSysTime;
+    detector.suspect = false;
+    detector.jams = 0;
+}
+
+/**
+ * @param int command The power the mechanism is being driven at
+ * @param bool suspect Whether the mechanism looks stuck
+ * @param bool sagging Whether the battery sag points at this mechanism too (halves the stall time)
+ * @param long lastTransition nSysTime of the last ball detector transition (balls are moving)
+ * @return int The power to drive the mechanism at
+ */
+int stepJam(JamDetector & detector, int command, bool suspect, bool sagging, long lastTransition) {
+    switch(detector.state) {
+        case JAM_REVERSE:
+            if (nSysTime - detector.stateSince < detector.reverseTime) return -command;
+
+            detector.state = JAM_FORWARD;
+            detector.stateSince = nSysTime;
+            return command;
+
+        case JAM_FORWARD:
+            if (nSysTime - detector.stateSince < detector.forwardTime) return command;
+
+            detector.state = JAM_NONE;
+            detector.suspect = false;
+            return command;
+    }
+
+    if (!suspect || command == 0) {
+        detector.suspect = false;
+        return command;
+    }
+
+    if (!detector.suspect) {
+        detector.suspect = true;
+        detector.suspectSince = nSysTime;
+    }
+
+    int stuckFor = nSysTime - (detector.suspectSince > lastTransition ? detector.suspectSince : lastTransition);
+    int stallTime = sagging ? detector.stallTime / 2 : detector.stallTime;
+
+    if (stuckFor > stallTime) {
+        detector.state = JAM_REVERSE;
+        detector.stateSince = nSysTime;
+        detector.jams++;
+        writeDebugStreamLine("Unjam %d", detector.jams);
+        return -command;
+    }
+
+    return command;
+}
@@ -4,6 +4,10 @@
 
 #pragma systemFile
 #include "./auton.c"
+#include "./lcdinput.c"
+#include "./lcdrender.c"
+
+#define LCD_DEBUG_REFRESH 50 // ms between debug display refreshes when no buttons are pressed
 
 
 void lcdClear() {
@@ -13,6 +17,25 @@ void lcdClear() {
 
 int lcdDebugSlot = 0;
 
+#if PROFILE_ENABLED
+// Names for the profile pages, in profile slot order
+string lcdProfileNames[PROFILE_SLOTS] = { "HAL", "MEAS", "DRV", "TAKR", "FLY", "MOTR", "THRM", "LCD", "LCDI", "CONS", "TELE", "WDOG" };
+
+/**
+ * Shows a profile slot on a line: "NAME avg/max share%"
+ **/
+void lcdPutProfile(int line, int slot) {
+    int col = lcdPutString(line, 0, lcdProfileNames[slot]);
+    col = lcdPutChar(line, col, ' ');
+    col = lcdPutFixed(line, col, profileSlots[slot].average, 2);
+    col = lcdPutChar(line, col, '/');
+    col = lcdPutInt(line, col, profileSlots[slot].slowest);
+    col = lcdPutChar(line, col, ' ');
+    col = lcdPutFixed(line, col, profileSlots[slot].share, 1);
+    lcdPutChar(line, col, '%');
+}
+#endif
+
 void lcdDisplayDebug(int slot) {
     lcdDebugSlot = slot;
 }
@@ -30,47 +53,142 @@ bool lcdUIOkay() {
 
 
 task lcdDebug() {
+    LCDEvent event;
+    event.type = LCD_NONE;
+    event.button = 0;
+    int col;
+    int hottest;
+
+    // The menus write to the LCD directly
+    lcdInvalidate();
+
     while(true) {
-        if (nLCDButtons == kButtonLeft && lcdDebugSlot > 0) lcdDebugSlot--;
-        if (nLCDButtons == kButtonRight) lcdDebugSlot++;
+        if (lcdIsPress(event, kButtonLeft) && lcdDebugSlot > 0) lcdDebugSlot--;
+        if (lcdIsPress(event, kButtonRight)) lcdDebugSlot++;
 
-        lcdClear();
-        string lineOne;
-        string lineTwo;
+        profileBegin(PROFILE_LCD);
+        lcdFrameClear();
 
         switch(lcdDebugSlot) {
 
             // Normal access displays
             case 0:
-                sprintf(lineOne, "%d (%s)", motor[FlywheelOut], abs(robot.flywheel.error) < 200 ? "STABLE" : "UNSTABLE" );
-                sprintf(lineTwo, "%1.2f-%1.2f", robot.flywheel.setpoint, robot.flywheel.process);
+                col = lcdPutInt(0, 0, motor[FlywheelOut]);
+                lcdPutString(0, col, abs(robot.flywheel.error) < 200 ? " (STABLE)" : " (UNSTABLE)");
+                col = lcdPutInt(1, 0, robot.flywheel.setpoint);
+                col = lcdPutChar(1, col, '-');
+                lcdPutInt(1, col, robot.flywheel.process);
                 break;
             case 1:
-                sprintf(lineOne, "%d => %d", robot.flywheel.error, robot.flywheel.output);
-                sprintf(lineTwo, "%d,%d,%d", robot.flywheel.tbh, robot.doubleShotMode, robot.intake);
+                col = lcdPutInt(0, 0, robot.flywheel.error);
+                col = lcdPutString(0, col, " => ");
+                lcdPutInt(0, col, robot.flywheel.output);
+                col = lcdPutInt(1, 0, robot.flywheel.tbh);
+                col = lcdPutChar(1, col, ',');
+                col = lcdPutInt(1, col, robot.doubleShotMode);
+                col = lcdPutChar(1, col, ',');
+                lcdPutInt(1, col, robot.intake);
                 break;
             case 2:
-                sprintf(lineOne, "IDXR:%s FRNG:%s", robot.ballLoaded ? "B" : "NB", robot.firing ? "Y" : "N");
-                sprintf(lineTwo, "%d", SensorValue[ballDetector]);
+                col = lcdPutString(0, 0, robot.ballLoaded ? "IDXR:B" : "IDXR:NB");
+                lcdPutString(0, col, robot.firing ? " FRNG:Y" : " FRNG:N");
+                // Raw, filtered, and latency of the last transition
+                col = lcdPutInt(1, 0, SensorValue[ballDetector]);
+                col = lcdPutChar(1, col, ' ');
+                col = lcdPutInt(1, col, robot.ballSonar.median);
+                col = lcdPutString(1, col, " L");
+                lcdPutInt(1, col, robot.ballSonar.latency);
                 break;
             case 3:
-                sprintf(lineOne, "M: %1.2fV", nImmediateBatteryLevel/1000.0);
-                sprintf(lineTwo, "E: %1.2fV B: %1.2fV", SensorValue[powerExpander]/270.0, BackupBatteryLevel/1000.0);
+                // Voltages in hundredths of a volt
+                col = lcdPutString(0, 0, "M: ");
+                col = lcdPutFixed(0, col, nImmediateBatteryLevel / 10, 2);
+                lcdPutChar(0, col, 'V');
+                col = lcdPutString(1, 0, "E:");
+                col = lcdPutFixed(1, col, SensorValue[powerExpander] * 100 / 270, 2);
+                col = lcdPutString(1, col, "V B:");
+                col = lcdPutFixed(1, col, BackupBatteryLevel / 10, 2);
+                lcdPutChar(1, col, 'V');
                 break;
             case 4:
-                sprintf(lineOne, "%d,%d (%d+%d)", robot.leftDrive, robot.rightDrive, robot.forward,robot.turn);
-                sprintf(lineTwo, "%d,%d,%1.1f", SensorValue[leftDrive], SensorValue[rightDrive], absoluteDirection(SensorValue[gyro]));
+                col = lcdPutInt(0, 0, robot.leftDrive);
+                col = lcdPutChar(0, col, ',');
+                col = lcdPutInt(0, col, robot.rightDrive);
+                col = lcdPutString(0, col, " (");
+                col = lcdPutInt(0, col, robot.forward);
+                col = lcdPutChar(0, col, '+');
+                col = lcdPutInt(0, col, robot.turn);
+                lcdPutChar(0, col, ')');
+                col = lcdPutInt(1, 0, SensorValue[leftDrive]);
+                col = lcdPutChar(1, col, ',');
+                col = lcdPutInt(1, col, SensorValue[rightDrive]);
+                col = lcdPutChar(1, col, ',');
+                lcdPutFixed(1, col, absoluteDirection(robot.heading.angle) * 10, 1);
+                break;
+            case 5:
+                // Hottest motor: port, estimated PTC temperature and power limit, then seconds until it trips
+                hottest = thermalHottest();
+                col = lcdPutString(0, 0, "PTC P");
+                col = lcdPutInt(0, col, hottest + 1);
+                col = lcdPutChar(0, col, ' ');
+                col = lcdPutInt(0, col, motorThermal[hottest].temperature);
+                col = lcdPutString(0, col, "C L");
+                lcdPutInt(0, col, motorThermalLimit[hottest]);
+                col = lcdPutString(1, 0, "TRIP ");
+                if (motorThermal[hottest].timeToTrip >= THERMAL_NEVER) {
+                    lcdPutString(1, col, "NEVER");
+                } else {
+                    col = lcdPutFixed(1, col, motorThermal[hottest].timeToTrip * 10, 1);
+                    lcdPutChar(1, col, 's');
+                }
+                break;
+#if PROFILE_ENABLED
+            case 6:
+            case 7:
+            case 8:
+            case 9:
+            case 10:
+            case 11:
+                // Profiling, two slots per page (average and worst time in ms, and CPU share)
+                lcdPutProfile(0, (lcdDebugSlot - 6) * 2);
+                lcdPutProfile(1, (lcdDebugSlot - 6) * 2 + 1);
+                break;
+            case 12:
+                // CPU used by every task, from the idle counter, and HAL cycles in the last window
+                col = lcdPutString(0, 0, "CPU ");
+                col = lcdPutFixed(0, col, profileBusy, 1);
+                lcdPutChar(0, col, '%');
+                col = lcdPutString(1, 0, "HAL ");
+                col = lcdPutInt(1, col, profileSlots[PROFILE_HAL].iterations);
+                lcdPutString(1, col, "/window");
                 break;
+#endif
             default:
-                sprintf(lineOne, "LCD DEBUG SYSTEM");
-                sprintf(lineTwo, "Slot %d", lcdDebugSlot);
+                lcdPutString(0, 0, "LCD DEBUG SYSTEM");
+                col = lcdPutString(1, 0, "Slot ");
+                lcdPutInt(1, col, lcdDebugSlot);
 
         }
 
-        displayLCDString(0, 0, lineOne);
-        displayLCDString(1, 0, lineTwo);
-        wait1Msec(140);
+        lcdFlush();
+        profileEnd(PROFILE_LCD);
+
+        // Redraw immediately on a button press, otherwise periodically
+        lcdNextEvent(event, LCD_DEBUG_REFRESH);
+    }
 }
+
+bool lcdDebugRunning = false;
+
+/**
+ * Starts the debug display if it isn't already running
+ **/
+void lcdDebugStart() {
+    if (lcdDebugRunning) return;
+
+    lcdInputStart();
+    lcdDebugRunning = true;
+    startTask(lcdDebug);
 }
 
 /**
@@ -81,25 +199,34 @@ task lcdDebug() {
  **/
 int lcdPick(int line, char * leftOption, char * rightOption) {
     int choice = 0;
+    int prev_choice = -1;
+    LCDEvent event;
 
     string indicator = "*";
     string spacer = "  ";
 
     clearLCDLine(line);
 
-    while(nLCDButtons != 2 && lcdUIOkay()) {
-        string buffer = "";
-        if (nLCDButtons == 1) choice = 0;
-        if (nLCDButtons == 4) choice = 1;
+    while(lcdUIOkay()) {
+        if(prev_choice != choice) {
+            string buffer = "";
+
+            if(!choice) strncat(buffer, indicator, 1);
+            strncat(buffer, leftOption, sizeof(leftOption));
+            strncat(buffer, spacer, 2);
+            if(choice) strncat(buffer, indicator, 1);
+            strncat(buffer, rightOption, sizeof(rightOption));
+
+            displayLCDCenteredString(line, buffer); // All UI components, by default, display on line 1
+            prev_choice = choice;
+        }
 
-        if(!choice) strncat(buffer, indicator, 1);
-        strncat(buffer, leftOption, sizeof(leftOption));
-        strncat(buffer, spacer, 2);
-        if(choice) strncat(buffer, indicator, 1);
-        strncat(buffer, rightOption, sizeof(rightOption));
+        // Enabling the robot queues an LCD_MODE event, so lcdUIOkay() is rechecked without polling
+        if (!lcdNextEvent(event, LCD_FOREVER) || event.type != LCD_PRESS) continue;
 
-        displayLCDCenteredString(line, buffer); // All UI components, by default, display on line 1
-        wait1Msec(140);
+        if (event.button == kButtonLeft) choice = 0;
+        if (event.button == kButtonRight) choice = 1;
+        if (event.button == kButtonCenter) break;
     }
     lcdClear();
     return choice;
@@ -117,48 +244,51 @@ int lcdPick(int line, char * leftOption, char * rightOption) {
 int lcdMenu(int line, string * options, int size) {
 	int choice = 0;
 	int prev_choice = -1;
+	LCDEvent event;
 
     clearLCDLine(line);
 
 	while(lcdUIOkay()) {
-		if (nLCDButtons == kButtonLeft && choice > 0) {
-			choice--;
-		}
-		if (nLCDButtons == kButtonRight && choice < size - 1) {
-			choice++;
-		}
-		if (nLCDButtons == kButtonCenter) {
-			break;
-		}
-		string buffer = (string) options[choice];
-
 		if(prev_choice != choice) {
-			displayLCDCenteredString(line, buffer);
+			displayLCDCenteredString(line, options[choice]);
             displayLCDChar(line, 1, '<');
             displayLCDChar(line, 14, '>');
 		}
 
 		prev_choice = choice;
-        wait1Msec(140);
+
+		if (!lcdNextEvent(event, LCD_FOREVER)) continue;
+
+		if (lcdIsPress(event, kButtonLeft) && choice > 0) {
+			choice--;
+		}
+		if (lcdIsPress(event, kButtonRight) && choice < size - 1) {
+			choice++;
+		}
+		if (event.type == LCD_PRESS && event.button == kButtonCenter) {
+			break;
+		}
 	}
 
     return choice;
 }
 
 int lcdConfirm(char * lineOne, char * lineTwo, int confirmCode, int rejectCode) {
+    LCDEvent event;
+
+    displayLCDCenteredString(1, lineOne);
+    displayLCDCenteredString(2, lineTwo);
+
     while(lcdUIOkay()) {
-        displayLCDCenteredString(1, lineOne);
-        displayLCDCenteredString(2, lineTwo);
+        if (!lcdNextEvent(event, LCD_FOREVER) || event.type != LCD_PRESS) continue;
 
-        if(nLCDButtons == confirmCode) {
+        if(event.button == confirmCode) {
             return 1;
         }
 
-        if(nLCDButtons == rejectCode) {
+        if(event.button == rejectCode) {
             return 0;
         }
-
-        wait1Msec(140);
     }
 
     // Confirm if interrupted
@@ -169,21 +299,20 @@ int lcdConfirm(char * lineOne, char * lineTwo, int confirmCode, int rejectCode)
 void lcdStartup() {
 	bLCDBacklight = true;
     lcdClear();
+    lcdInputStart();
 
 
-    displayLCDCenteredString(0, "Secure the Flag");
-    displayLCDCenteredString(1, "3796B");
-    wait1Msec(1000);
-
     displayLCDCenteredString(0, "Alliance");
     match.alliance = lcdPick(1, "Red", "Blue");
-
-    wait1Msec(1000);
+    ballisticsAlliance = match.alliance;
 
     string autons[] = {"Front", "Back", "Prog Skills", "Test"};
 
     displayLCDCenteredString(0, "Auton");
     match.auton = lcdMenu(1, autons, 4);
 
+    displayLCDCenteredString(0, "Driver");
+    useDriverProfile(lcdMenu(1, driverProfileNames, DRIVER_PROFILE_COUNT));
+
     lcdClear();
 }
@@ -0,0 +1,168 @@
+/**
+ * lcdinput.c - LCD button input service
+ *
+ * A single sampler task reads nLCDButtons at a high rate, debounces each button, and queues press, release, long
+ * press and auto-repeat events. It also queues an event when the robot is enabled or disabled, as that decides
+ * whether menus may keep blocking (see lcdUIOkay). UI code blocks on the queue with lcdNextEvent instead of
+ * sampling the buttons as a level, so quick presses aren't missed, held presses don't skip through menus, and
+ * nothing but the sampler wakes up until there is something to handle.
+ *
+ * The sampler holds lcdEventReady whenever the queue is empty, so a task waiting in lcdNextEvent sleeps on the
+ * semaphore until the sampler lets go of it.
+ **/
+
+#pragma systemFile
+
+#define LCD_INPUT_PERIOD 5         // ms between button samples
+#define LCD_DEBOUNCE_SAMPLES 3     // Samples a button must hold a new state for before it counts
+#define LCD_LONG_PRESS_TIME 600    // ms held before a long press (and auto-repeat) begins
+#define LCD_REPEAT_PERIOD 150      // ms between auto-repeat events
+#define LCD_EVENT_QUEUE_SIZE 8
+#define LCD_FOREVER -1             // lcdNextEvent timeout that never expires
+
+enum lcdEventType {
+    LCD_NONE = 0,
+    LCD_PRESS = 1,
+    LCD_RELEASE = 2,
+    LCD_LONG_PRESS = 3,
+    LCD_REPEAT = 4,
+    LCD_MODE = 5    // The robot was enabled or disabled
+};
+
+typedef struct {
+    lcdEventType type;
+    int button; // kButtonLeft, kButtonCenter or kButtonRight
+} LCDEvent;
+
+LCDEvent lcdEventQueue[LCD_EVENT_QUEUE_SIZE];
+int lcdEventHead = 0; // Next event to read
+int lcdEventTail = 0; // Next slot to write
+
+// Held by the sampler while the queue is empty
+TSemaphore lcdEventReady;
+
+bool lcdInputRunning = false;
+
+/**
+ * Adds an event to the queue, dropping it if the queue is full
+ **/
+void lcdQueueEvent(lcdEventType type, int button) {
+    int next = (lcdEventTail + 1) % LCD_EVENT_QUEUE_SIZE;
+    if (next == lcdEventHead) return;
+
+    lcdEventQueue[lcdEventTail].type = type;
+    lcdEventQueue[lcdEventTail].button = button;
+    lcdEventTail = next;
+}
+
+task lcdInput() {
+    int buttons[3] = { kButtonLeft, kButtonCenter, kButtonRight };
+    bool held[3] = { false, false, false };
+    int pending[3] = { 0, 0, 0 };     // Consecutive samples disagreeing with held
+    long pressedAt[3] = { 0, 0, 0 };
+    long repeatAt[3] = { 0, 0, 0 };   // When the next long press / repeat event is due
+    bool longPressed[3] = { false, false, false };
+    bool disabled = bIfiRobotDisabled;
+
+    while(true) {
+        profileBegin(PROFILE_LCD_INPUT);
+        int sample = nLCDButtons;
+
+        for(int i = 0; i < 3; i++) {
+            bool down = (sample & buttons[i]) != 0;
+
+            // Debounce
+            if (down != held[i]) {
+                pending[i]++;
+            } else {
+                pending[i] = 0;
+            }
+
+            if (pending[i] >= LCD_DEBOUNCE_SAMPLES) {
+                held[i] = down;
+                pending[i] = 0;
+
+                if (down) {
+                    pressedAt[i] = nSysTime;
+                    repeatAt[i] = nSysTime + LCD_LONG_PRESS_TIME;
+                    longPressed[i] = false;
+                    lcdQueueEvent(LCD_PRESS, buttons[i]);
+                } else {
+                    lcdQueueEvent(LCD_RELEASE, buttons[i]);
+                }
+            }
+
+            // Long press, then auto-repeat while held
+            if (held[i] && nSysTime >= repeatAt[i]) {
+                lcdQueueEvent(longPressed[i] ? LCD_REPEAT : LCD_LONG_PRESS, buttons[i]);
+                longPressed[i] = true;
+                repeatAt[i] = nSysTime + LCD_REPEAT_PERIOD;
+            }
+        }
+
+        if (bIfiRobotDisabled != disabled) {
+            disabled = bIfiRobotDisabled;
+            lcdQueueEvent(LCD_MODE, 0);
+        }
+
+        // Wake whoever is waiting once there are events, and block them again once they are all handled
+        if (lcdEventHead != lcdEventTail) {
+            if (bDoesTaskOwnSemaphore(lcdEventReady)) semaphoreUnlock(lcdEventReady);
+        } else if (!bDoesTaskOwnSemaphore(lcdEventReady)) {
+            semaphoreLock(lcdEventReady, 0);
+        }
+        profileEnd(PROFILE_LCD_INPUT);
+
+        wait1Msec(LCD_INPUT_PERIOD);
+    }
+}
+
+/**
+ * Starts the input service if it isn't already running
+ **/
+void lcdInputStart() {
+    if (lcdInputRunning) return;
+
+    lcdEventHead = 0;
+    lcdEventTail = 0;
+    semaphoreInitialize(lcdEventReady);
+    lcdInputRunning = true;
+    startTask(lcdInput);
+}
+
+/**
+ * Blocks until the next LCD event
+ * @param LCDEvent event Filled in with the event, if there was one
+ * @param int timeout The longest to wait, in ms (LCD_FOREVER to wait as long as it takes)
+ * @return bool Whether an event was received before the timeout
+ **/
+bool lcdNextEvent(LCDEvent & event, int timeout) {
+    long deadline = nSysTime + timeout;
+
+    while(lcdEventHead == lcdEventTail) {
+        long remaining = timeout == LCD_FOREVER ? 0x7FFF : deadline - nSysTime;
+
+        if (remaining <= 0) {
+            event.type = LCD_NONE;
+            event.button = 0;
+            return false;
+        }
+
+        // Sleeps until the sampler releases it (or the timeout), then hands it straight back
+        semaphoreLock(lcdEventReady, remaining);
+        if (bDoesTaskOwnSemaphore(lcdEventReady)) semaphoreUnlock(lcdEventReady);
+    }
+
+    event.type = lcdEventQueue[lcdEventHead].type;
+    event.button = lcdEventQueue[lcdEventHead].button;
+    lcdEventHead = (lcdEventHead + 1) % LCD_EVENT_QUEUE_SIZE;
+
+    return true;
+}
+
+/**
+ * Whether an event is a press of a button, counting auto-repeats while it is held
+ **/
+bool lcdIsPress(LCDEvent & event, int button) {
+    return event.button == button && (event.type == LCD_PRESS || event.type == LCD_REPEAT);
+}
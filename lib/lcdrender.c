@@ -0,0 +1,123 @@
+/**
+ * lcdrender.c - Dirty-region LCD rendering
+ *
+ * Screens are drawn into a frame buffer, and lcdFlush() only sends the characters that differ from what is
+ * already on the LCD. Numbers are formatted with integer routines, so nothing here touches floats or sprintf.
+ **/
+
+#pragma systemFile
+
+#define LCD_WIDTH 16
+
+char lcdFrame[2][LCD_WIDTH];  // What we want on the screen
+char lcdShadow[2][LCD_WIDTH]; // What is actually on the screen
+
+/**
+ * Forgets what is on the screen, so the next flush redraws every character. Call after anything
+ * writes to the LCD directly
+ **/
+void lcdInvalidate() {
+    for(int line = 0; line < 2; line++) {
+        for(int col = 0; col < LCD_WIDTH; col++) {
+            lcdShadow[line][col] = 0;
+        }
+    }
+}
+
+void lcdFrameClear() {
+    for(int line = 0; line < 2; line++) {
+        for(int col = 0; col < LCD_WIDTH; col++) {
+            lcdFrame[line][col] = ' ';
+        }
+    }
+}
+
+/**
+ * Sends changed characters to the LCD
+ **/
+void lcdFlush() {
+    for(int line = 0; line < 2; line++) {
+        for(int col = 0; col < LCD_WIDTH; col++) {
+            if (lcdFrame[line][col] != lcdShadow[line][col]) {
+                displayLCDChar(line, col, lcdFrame[line][col]);
+                lcdShadow[line][col] = lcdFrame[line][col];
+            }
+        }
+    }
+}
+
+/**
+ * Puts a character into the frame, clipping anything off screen
+ * @return int The column after the character
+ **/
+int lcdPutChar(int line, int col, char c) {
+    if (col >= 0 && col < LCD_WIDTH) {
+        lcdFrame[line][col] = c;
+    }
+    return col + 1;
+}
+
+/**
+ * @return int The column after the text
+ **/
+int lcdPutString(int line, int col, char * text) {
+    for(int i = 0; text[i] != 0 && col < LCD_WIDTH; i++) {
+        col = lcdPutChar(line, col, text[i]);
+    }
+    return col;
+}
+
+/**
+ * @return int The column after the number
+ **/
+int lcdPutInt(int line, int col, long value) {
+    char digits[10];
+    int count = 0;
+
+    if (value < 0) {
+        col = lcdPutChar(line, col, '-');
+        value = -value;
+    }
+
+    do {
+        digits[count++] = '0' + value % 10;
+        value /= 10;
+    } while(value > 0 && count < 10);
+
+    while(count > 0) {
+        col = lcdPutChar(line, col, digits[--count]);
+    }
+    return col;
+}
+
+/**
+ * Puts a fixed-point number into the frame
+ * Usage:
+ *  lcdPutFixed(0, 3, 782, 2); // "7.82"
+ *
+ * @param long value The number, multiplied by 10^decimals
+ * @param int decimals The number of digits after the decimal point
+ * @return int The column after the number
+ **/
+int lcdPutFixed(int line, int col, long value, int decimals) {
+    long scale = 1;
+    for(int i = 0; i < decimals; i++) scale *= 10;
+
+    if (value < 0) {
+        col = lcdPutChar(line, col, '-');
+        value = -value;
+    }
+
+    col = lcdPutInt(line, col, value / scale);
+    if (decimals == 0) return col;
+
+    col = lcdPutChar(line, col, '.');
+
+    // Fractional digits, keeping leading zeros
+    long fraction = value % scale;
+    for(int i = 0; i < decimals; i++) {
+        scale /= 10;
+        col = lcdPutChar(line, col, '0' + (fraction / scale) % 10);
+    }
+    return col;
+}
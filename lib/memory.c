@@ -0,0 +1,63 @@
+/**
+ * memory.c - RAM budget
+ *
+ * RobotC has no heap, so every byte is either a global or on a task's stack. The big globals are measured against
+ * a budget at boot, and anything over budget is logged, so that a struct quietly growing is noticed before we run
+ * out of room. Only globals are covered: RobotC doesn't report task stack use at runtime, so stacks are checked in
+ * the compiler's statistics instead; keep large buffers global and shared (like consoleScratch) rather than local.
+ *
+ * Budgets are estimates worked out from the struct layouts, not taken from a robot. Once the boot report (or "mem"
+ * on the console) has given real sizes, bring each budget down to a little above its size, and after that raise
+ * them deliberately when something needs to grow.
+ */
+
+#pragma systemFile
+
+#include "../hal.c"
+#include "lcd.c"
+
+#define MEMORY_ITEMS 9
+
+string memoryNames[MEMORY_ITEMS] = { "robot", "thermal", "profile", "motors", "curve", "lcd", "lcdinput", "encoders", "flywheel" };
+int memoryBudget[MEMORY_ITEMS] = { 480, 200, 288, 1200, 512, 64, 40, 160, 200 };
+int memorySize[MEMORY_ITEMS];
+
+void memoryMeasure() {
+    memorySize[0] = sizeof(robot);
+    memorySize[1] = sizeof(motorThermal);
+#if PROFILE_ENABLED
+    memorySize[2] = sizeof(profileSlots);
+#else
+    memorySize[2] = 0;
+#endif
+    memorySize[3] = sizeof(motorTarget) + sizeof(motorSlew) + sizeof(motorSlewLastSet) + sizeof(motorDeadband) +
+        sizeof(motorTrueSpeed) + sizeof(motorThermalLimit) + sizeof(MC29) + sizeof(HBRIDGE);
+    memorySize[4] = sizeof(driveCurve) + sizeof(driverProfiles);
+    memorySize[5] = sizeof(lcdFrame) + sizeof(lcdShadow);
+    memorySize[6] = sizeof(lcdEventQueue);
+    memorySize[7] = sizeof(flywheelEncoder) + sizeof(leftEncoder) + sizeof(rightEncoder);
+    memorySize[8] = sizeof(flywheelHold) + sizeof(flywheelSchedule);
+}
+
+/**
+ * Measures the globals and logs the report to the debug stream
+ * @return int The number of items over budget
+ */
+int memoryCheck() {
+    int over = 0;
+    int total = 0;
+
+    memoryMeasure();
+
+    for(int i = 0; i < MEMORY_ITEMS; i++) {
+        total += memorySize[i];
+
+        if (memorySize[i] > memoryBudget[i]) {
+            over++;
+            writeDebugStreamLine("MEMORY %s over budget: %d / %d bytes", memoryNames[i], memorySize[i], memoryBudget[i]);
+        }
+    }
+
+    writeDebugStreamLine("Memory: %d bytes measured, %d over budget", total, over);
+    return over;
+}
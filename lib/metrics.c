@@ -0,0 +1,137 @@
+/**
+ * metrics.c - Flywheel and shooting performance metrics
+ *
+ * Measures, on the robot, the numbers we tune for:
+ *  Spin up   Setpoint raised until the error first falls inside the fire band
+ *  Settle    Setpoint raised until the error has stayed inside the fire band for METRICS_SETTLE_HOLD
+ *  Recovery  A shot (the flywheel dropping by METRICS_SHOT_DROP) until the error is back inside the fire band
+ *  Cadence   Time between consecutive shots in a burst (a gap over METRICS_BURST_GAP starts a new burst)
+ *
+ * Each measurement is compared against a stored baseline, and anything more than METRICS_TOLERANCE percent slower
+ * is logged as a regression, so a tuning change that makes things worse is caught in the pits. tools/sim.py runs this
+ * file, with the rest of the HAL, against a simulated flywheel, to catch it before it gets to the robot.
+ */
+
+#pragma systemFile
+
+#define METRICS_SETTLE_HOLD 200 // ms
+#define METRICS_SHOT_DROP 300   // RPM
+#define METRICS_TOLERANCE 20    // percent
+#define METRICS_BURST_GAP 3000  // ms without a shot that ends a burst, so pauses between bursts aren't cadence
+
+// Baselines (ms), from the current tuning
+#define METRICS_BASELINE_SPINUP 1800
+#define METRICS_BASELINE_SETTLE 2200
+#define METRICS_BASELINE_RECOVERY 600
+#define METRICS_BASELINE_CADENCE 900
+
+#define METRIC_SPINUP 0
+#define METRIC_SETTLE 1
+#define METRIC_RECOVERY 2
+#define METRIC_CADENCE 3
+#define METRIC_COUNT 4
+
+typedef struct {
+    int last[METRIC_COUNT];     // Last measurement, ms
+    int best[METRIC_COUNT];     // Best measurement, ms
+    int baseline[METRIC_COUNT];
+    int samples[METRIC_COUNT];
+    int regressions;
+    int shots;
+
+    float lastSetpoint;
+    long spinUpStart;   // 0 when not spinning up
+    bool spunUp;
+    long inBandSince;   // 0 when outside the band
+    long recoveryStart; // 0 when not recovering
+    long lastShot;
+} FlywheelMetrics;
+
+FlywheelMetrics metrics;
+
+void initMetrics() {
+    metrics.baseline[METRIC_SPINUP] = METRICS_BASELINE_SPINUP;
+    metrics.baseline[METRIC_SETTLE] = METRICS_BASELINE_SETTLE;
+    metrics.baseline[METRIC_RECOVERY] = METRICS_BASELINE_RECOVERY;
+    metrics.baseline[METRIC_CADENCE] = METRICS_BASELINE_CADENCE;
+
+    for(int i = 0; i < METRIC_COUNT; i++) {
+        metrics.last[i] = 0;
+        metrics.best[i] = 0;
+        metrics.samples[i] = 0;
+    }
+
+    metrics.regressions = 0;
+    metrics.shots = 0;
+    metrics.lastSetpoint = 0;
+    metrics.spinUpStart = 0;
+    metrics.spunUp = false;
+    metrics.inBandSince = 0;
+    metrics.recoveryStart = 0;
+    metrics.lastShot = 0;
+}
+
+void metricsRecord(int metric, int value) {
+    metrics.last[metric] = value;
+    if (metrics.samples[metric] == 0 || value < metrics.best[metric]) metrics.best[metric] = value;
+    metrics.samples[metric]++;
+
+    if (value * 100 > metrics.baseline[metric] * (100 + METRICS_TOLERANCE)) {
+        metrics.regressions++;
+        writeDebugStreamLine("REGRESSION metric %d: %d ms (baseline %d ms)", metric, value, metrics.baseline[metric]);
+    }
+}
+
+/**
+ * @param TBHController flywheel The flywheel controller, after it has been stepped
+ * @param int band The error (RPM) considered on target
+ */
+void metricsStep(TBHController & flywheel, int band) {
+    bool inBand = abs(flywheel.setpoint - flywheel.process) < band;
+
+    // Setpoint raised: start timing spin up (lowering it isn't interesting)
+    if (flywheel.setpoint > metrics.lastSetpoint) {
+        metrics.spinUpStart = nSysTime;
+        metrics.spunUp = false;
+        metrics.recoveryStart = 0;
+    } else if (flywheel.setpoint < metrics.lastSetpoint) {
+        metrics.spinUpStart = 0;
+    }
+    metrics.lastSetpoint = flywheel.setpoint;
+
+    if (flywheel.setpoint == 0) return;
+
+    if (inBand) {
+        if (metrics.inBandSince == 0) metrics.inBandSince = nSysTime;
+    } else {
+        metrics.inBandSince = 0;
+    }
+
+    if (metrics.spinUpStart != 0) {
+        if (inBand && !metrics.spunUp) {
+            metrics.spunUp = true;
+            metricsRecord(METRIC_SPINUP, nSysTime - metrics.spinUpStart);
+        }
+        if (metrics.inBandSince != 0 && nSysTime - metrics.inBandSince >= METRICS_SETTLE_HOLD) {
+            metricsRecord(METRIC_SETTLE, metrics.inBandSince - metrics.spinUpStart);
+            metrics.spinUpStart = 0;
+        }
+        return;
+    }
+
+    // A shot takes a chunk out of the flywheel speed
+    if (metrics.recoveryStart == 0 && flywheel.setpoint - flywheel.process > METRICS_SHOT_DROP) {
+        metrics.recoveryStart = nSysTime;
+        metrics.shots++;
+
+        if (metrics.lastShot != 0 && nSysTime - metrics.lastShot <= METRICS_BURST_GAP) {
+            metricsRecord(METRIC_CADENCE, nSysTime - metrics.lastShot);
+        }
+        metrics.lastShot = nSysTime;
+    }
+
+    if (metrics.recoveryStart != 0 && inBand) {
+        metricsRecord(METRIC_RECOVERY, nSysTime - metrics.recoveryStart);
+        metrics.recoveryStart = 0;
+    }
+}
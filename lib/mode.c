@@ -0,0 +1,72 @@
+/**
+ * mode.c - Competition mode transitions
+ *
+ * bStopTasksBetweenModes is false, so the HAL and debug display keep running from autonomous into driver
+ * control. Each mode calls in here instead of starting tasks itself, so nothing is started twice and the
+ * flywheel keeps spinning through the transition instead of being commanded back to zero.
+ **/
+
+#pragma systemFile
+
+#include "../hal.c"
+#include "lcd.c"
+
+enum robotMode {
+    MODE_DISABLED = 0,
+    MODE_AUTONOMOUS = 1,
+    MODE_DRIVER = 2
+};
+
+robotMode currentMode = MODE_DISABLED;
+
+// Flywheel target when driver control starts with the flywheel idle. Off (0) unless set from the console, so the
+// flywheel never starts by itself just because driver control was enabled
+int driverStartRPM = 0;
+
+void modeStartTasks() {
+    startHAL();
+    lcdDebugStart();
+}
+
+void modeEnterAutonomous() {
+    // Positions and headings are relative to the starting tile. Re-baseline before the HAL starts (or without
+    // letting it run, if it already is) so nothing turned or pushed before the match is integrated
+    hogCPU();
+    resetHeading(robot.heading, SensorValue[gyro]);
+    resetOdometry(robot.pose, 0, 0, 0);
+    releaseCPU();
+
+    modeStartTasks();
+
+    // Autonomous throughput is measured on its own
+    resetFlow();
+    currentMode = MODE_AUTONOMOUS;
+}
+
+void modeEnterDriver() {
+    modeStartTasks();
+
+    if (currentMode == MODE_AUTONOMOUS) {
+        writeDebugStreamLine("Autonomous throughput");
+        flowReport();
+        resetFlow();
+    }
+
+    // Drop anything autonomous left behind, but keep the flywheel controller as is. The HAL is already running,
+    // so don't let it see half of this
+    hogCPU();
+    robot.leftDrive = 0;
+    robot.rightDrive = 0;
+    robot.indexerOverride = STOP;
+    robot.intake = STOP;
+    robot.firing = false;
+    robot.doubleShotMode = 0;
+    robot.disableFlywheelControl = false;
+
+    if (robot.flywheel.setpoint == 0) {
+        targetTBH(robot.flywheel, driverStartRPM);
+    }
+    releaseCPU();
+
+    currentMode = MODE_DRIVER;
+}
@@ -1,5 +1,6 @@
 /**
  * motor.c - Improved motor control including slew rate, truespeed, deadband, and motor groups. Includes PID control for motors as well
+ * (drive response curves are in curve.c)
  */
 
 #pragma systemFile
@@ -8,20 +9,122 @@
 
 // Stores motor targets, use this instead of motor[]
 int motorTarget[10] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
-int motorSlew[10] = { 10, 127, 127, 127, 127, 127, 127, 127, 127, 10 };
-int motorSlewLastSet[10] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+// Slew rate in power per millisecond, so acceleration doesn't depend on how often motorControlStep() runs
+// (MOTOR_SLEW_NONE lets a motor go from full reverse to full forward in a single 20ms step)
+#define MOTOR_SLEW_NONE 12.7
+float motorSlew[10] = { 0.5, MOTOR_SLEW_NONE, MOTOR_SLEW_NONE, MOTOR_SLEW_NONE, MOTOR_SLEW_NONE, MOTOR_SLEW_NONE, MOTOR_SLEW_NONE, MOTOR_SLEW_NONE, MOTOR_SLEW_NONE, 0.5 };
+float motorSlewLastSet[10] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
 int motorDeadband[10] = { 15, 15, 15, 15, 15, 15, 15, 15, 15, 15 };
 
-// Logistic Curve to help with driving
-int LOGISTIC[] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 25, 26, 27, 28, 29, 31, 32, 33, 34, 35, 37, 38, 39, 41, 42, 44, 45, 46, 48, 49, 51, 52, 54, 56, 57, 59, 60, 62, 64, 65, 67, 68, 70, 71, 73, 75, 76, 78, 79, 81, 82, 83, 85, 86, 88, 89, 90, 92, 93, 94, 95, 96, 98, 99, 100, 101, 102, 103, 104, 105, 106, 107, 107, 108, 109, 110, 110, 111, 112, 113, 113, 114, 114, 115, 115, 116, 116, 117, 117, 118, 118, 119, 119, 119, 120, 120, 120, 121, 121, 121, 122, 122, 122, 122, 122, 123, 123, 123, 123, 123, 124, 124, 124, 124, 124, 124, 124, 125, 125, 125, 125, 127, 127, 127, 127, 127, 127, 127, 127, 127 };
-int logistic(int n) {
-  return sgn(n) * LOGISTIC[abs(n)];
+// Whether to apply TrueSpeed linearization. The flywheel is left raw, because the double shot hold power is
+// tuned against raw PWM, and so is the indexer (port 1), because its feed speed (70), and with it shot cadence
+// and jam timing, is tuned against raw PWM too. Port 10 is the other H-bridge port, and HBRIDGE is unmeasured
+bool motorTrueSpeed[10] = { false, false, true, true, true, true, true, true, true, false };
+
+// Largest power each motor may run at, lowered by the thermal model (see thermal.c) as a PTC heats up
+int motorThermalLimit[10] = { 127, 127, 127, 127, 127, 127, 127, 127, 127, 127 };
+
+long motorLastStep = 0;
+
+/**
+ * TrueSpeed - Maps a desired speed (0 - 127) to the power that actually produces it
+ *
+ * MC29: Measured speed vs power, inverted. The MC29 is close to full speed by 90, so anything above that is
+ * pushed to 127
+ */
+int MC29[128] = {
+      0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+      0, 21, 21, 21, 22, 22, 22, 23, 24, 24,
+     25, 25, 25, 25, 26, 27, 27, 28, 28, 28,
+     28, 29, 30, 30, 30, 31, 31, 32, 32, 32,
+     33, 33, 34, 34, 35, 35, 35, 36, 36, 37,
+     37, 37, 37, 38, 38, 39, 39, 39, 40, 40,
+     41, 41, 42, 42, 43, 44, 44, 45, 45, 46,
+     46, 47, 47, 48, 48, 49, 50, 50, 51, 52,
+     52, 53, 54, 55, 56, 57, 57, 58, 59, 60,
+     61, 62, 63, 64, 65, 66, 67, 67, 68, 70,
+     71, 72, 72, 73, 74, 76, 77, 78, 79, 79,
+     80, 81, 83, 84, 84, 86, 86, 87, 87, 88,
+     88, 89, 89, 90, 90,127,127,127
+};
+
+/**
+ * HBRIDGE: Cortex ports 1 and 10, which drive the motor directly. Generated by inverting
+ * speed = (1 - e^(-k(power - d))) / (1 - e^(-k(127 - d))) with d = 8 (stall) and k = 0.02. This is a model, not a
+ * measurement (unlike MC29), so nothing uses it by default; measure before turning it on for a port
+ */
+int HBRIDGE[128] = {
+      0,  8,  9,  9,  9, 10, 10, 11, 11, 11,
+     12, 12, 12, 13, 13, 14, 14, 14, 15, 15,
+     16, 16, 17, 17, 17, 18, 18, 19, 19, 20,
+     20, 21, 21, 21, 22, 22, 23, 23, 24, 24,
+     25, 25, 26, 26, 27, 27, 28, 28, 29, 30,
+     30, 31, 31, 32, 32, 33, 34, 34, 35, 35,
+     36, 37, 37, 38, 39, 39, 40, 41, 41, 42,
+     43, 43, 44, 45, 46, 46, 47, 48, 49, 50,
+     50, 51, 52, 53, 54, 55, 56, 57, 58, 59,
+     60, 61, 62, 63, 64, 65, 66, 67, 68, 69,
+     71, 72, 73, 75, 76, 77, 79, 80, 82, 83,
+     85, 87, 89, 90, 92, 94, 96, 98,101,103,
+    105,108,111,114,117,120,123,127
+};
+
+/**
+ * Motor Groups - Several motors that always run together (like one side of the drive)
+ */
+#define MOTOR_GROUP_SIZE 4
+
+typedef struct {
+    int ports[MOTOR_GROUP_SIZE];
+    bool reversed[MOTOR_GROUP_SIZE];
+    int count;
+} MotorGroup;
+
+void motorGroupInit(MotorGroup & group) {
+    group.count = 0;
+}
+
+/**
+ * Adds a motor to a group
+ * @param int port The motor (as named in the motor config)
+ * @param bool reversed Whether this motor runs opposite to the rest of the group
+ */
+void motorGroupAdd(MotorGroup & group, int port, bool reversed) {
+    if (group.count >= MOTOR_GROUP_SIZE) return;
+
+    group.ports[group.count] = port;
+    group.reversed[group.count] = reversed;
+    group.count++;
+}
+
+/**
+ * Applies the same slew rate, deadband and TrueSpeed setting to every motor in a group
+ */
+void motorGroupConfigure(MotorGroup & group, float slew, int deadband, bool trueSpeed) {
+    for(int i = 0; i < group.count; i++) {
+        motorSlew[group.ports[i]] = slew;
+        motorDeadband[group.ports[i]] = deadband;
+        motorTrueSpeed[group.ports[i]] = trueSpeed;
+    }
 }
 
+/**
+ * Sets the target of every motor in a group
+ */
+void motorGroupSet(MotorGroup & group, int power) {
+    for(int i = 0; i < group.count; i++) {
+        motorTarget[group.ports[i]] = group.reversed[i] ? -power : power;
+    }
+}
 
 void motorControlStep() {
     int outs[10]; // Stores intermediate output values
-    int motorCurrent; // Temp variable used for slew rate
+    float motorCurrent; // Temp variable used for slew rate
+
+    // Time since the last step, capped so a long pause doesn't skip the slew entirely
+    int dt = clamp(nSysTime - motorLastStep, 1, 100);
+    motorLastStep = nSysTime;
+
     // Loop through each motor slot
     for(int i = 0; i < 10; i++) {
 
@@ -33,25 +136,34 @@ void motorControlStep() {
             outs[i] = 0;
         }
 
-        // 3. Slew Rate - Gradually increases motor power, reducing the chance of PTC trips
+        // 3. Thermal Limit
+        outs[i] = clampAbs(outs[i], motorThermalLimit[i]);
+
+        // 4. Slew Rate - Gradually increases motor power, reducing the chance of PTC trips
         motorCurrent = motorSlewLastSet[i];
         if(motorCurrent != outs[i]) {
             motorCurrent +=
             sgn(outs[i] - motorCurrent) * // Whether to increase or decrease in value
-            clamp(motorSlew[i], 0, abs(outs[i] - motorCurrent)); // The amount to increase, the clamp prevents the value from being greater than the difference remaining
+            clamp(motorSlew[i] * dt, 0, abs(outs[i] - motorCurrent)); // The amount to increase, the clamp prevents the value from being greater than the difference remaining
         }
 
+        // Keep the fractional part, so slow slews still make progress every step
+        motorSlewLastSet[i] = motorCurrent;
         outs[i] = motorCurrent;
-        motorSlewLastSet[i] = outs[i];
 
-        // 4. TrueSpeed - Standardizes the acceleration curve of the Motor Controller
-        // if(i == 0 || i == 9) {
-        //     outs[i] = sgn(outs[i]) * L298[abs(outs[i])];
-        // } else {
-        //     outs[i] = sgn(outs[i]) * MC29[abs(outs[i])];
-        // }
+        // 5. TrueSpeed - Standardizes the acceleration curve of the Motor Controller
+        if (motorTrueSpeed[i]) {
+            if(i == 0 || i == 9) {
+                outs[i] = sgn(outs[i]) * HBRIDGE[abs(outs[i])];
+            } else {
+                outs[i] = sgn(outs[i]) * MC29[abs(outs[i])];
+            }
+        }
 
-        // 5. Set Motor
-        motor[i] = outs[i];
+        // 6. Set Motor, only if it changed. Compared against motor[] itself rather than a copy, because the firmware
+        // zeroes it while disabled (and the watchdog clamps it), and the motor has to be written again after that
+        if (motor[i] != outs[i]) {
+            motor[i] = outs[i];
+        }
     }
 }
@@ -0,0 +1,59 @@
+/**
+ * odometry.c - Position tracking from the drive encoders and gyro
+ *
+ * Field frame: the pose is relative to wherever the robot was when resetOdometry() was called. x is forward from
+ * there, y is to the left, and heading is in degrees, counterclockwise (like the gyro), and doesn't wrap.
+ */
+
+#pragma systemFile
+
+#include "util.c"
+
+typedef struct {
+    float x; // inches
+    float y; // inches
+    float heading; // degrees
+
+    float inchesPerTick;
+} Odometry;
+
+void initOdometry(Odometry & odometry, float inchesPerTick) {
+    odometry.inchesPerTick = inchesPerTick;
+}
+
+void resetOdometry(Odometry & odometry, float x, float y, float heading) {
+    odometry.x = x;
+    odometry.y = y;
+    odometry.heading = heading;
+}
+
+/**
+ * Advances the pose by one step
+ * @param int leftTicks Left drive encoder change since the last step
+ * @param int rightTicks Right drive encoder change since the last step
+ * @param float headingChange Gyro change since the last step, in degrees
+ */
+void stepOdometry(Odometry & odometry, int leftTicks, int rightTicks, float headingChange) {
+    float distance = (leftTicks + rightTicks) * 0.5 * odometry.inchesPerTick;
+
+    // Move along the average heading over the step
+    float heading = (odometry.heading + headingChange * 0.5) * RADIANS_PER_DEGREE;
+
+    odometry.x += distance * cos(heading);
+    odometry.y += distance * sin(heading);
+    odometry.heading += headingChange;
+}
+
+/**
+ * @return float Distance from the robot to a point, in inches
+ */
+float odometryDistanceTo(Odometry & odometry, float x, float y) {
+    return sqrt((x - odometry.x) * (x - odometry.x) + (y - odometry.y) * (y - odometry.y));
+}
+
+/**
+ * @return float Field heading that faces a point, in degrees (-180 - 180)
+ */
+float odometryBearingTo(Odometry & odometry, float x, float y) {
+    return atan2(y - odometry.y, x - odometry.x) * DEGREES_PER_RADIAN;
+}
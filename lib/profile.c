@@ -0,0 +1,148 @@
+/**
+ * profile.c - Execution time profiling
+ *
+ * Records how long each HAL step and each task's loop takes, and how many times it ran, and publishes min/avg/max,
+ * iterations and CPU share once every PROFILE_WINDOW. Define PROFILE_ENABLED as 0 before including this to compile
+ * the instrumentation out, along with the LCD pages and telemetry frames that show it.
+ *
+ * The clock is nSysTime, which only counts whole milliseconds. Loops start right after wait1Msec wakes them, so
+ * on a tick, and a step shorter than a millisecond reads 0 every time: slot times only mean something for steps
+ * of a few ms, and for catching the slow ones. Iterations per window are exact, so they show a task keeping up.
+ *
+ * How busy the CPU is gets measured separately, finer than a millisecond: profileIdle runs below every other task
+ * and counts loops whenever nothing else wants the CPU. profileCalibrate counts the same loop with the CPU to
+ * itself, and the spins missing from a window are the time everything else used.
+ */
+
+#pragma systemFile
+
+#ifndef PROFILE_ENABLED
+#define PROFILE_ENABLED 1
+#endif
+
+#define PROFILE_WINDOW 1000     // ms
+#define PROFILE_CALIBRATION 50  // ms spent counting spins with the CPU hogged, at startup
+
+// Slots
+#define PROFILE_HAL 0       // The whole HAL cycle, excluding the wait
+#define PROFILE_MEASURE 1
+#define PROFILE_DRIVE 2
+#define PROFILE_TAKER 3
+#define PROFILE_FLYWHEEL 4
+#define PROFILE_MOTOR 5
+#define PROFILE_THERMAL 6
+#define PROFILE_LCD 7       // lcdDebug, per refresh
+#define PROFILE_LCD_INPUT 8 // The rest are one loop of each task
+#define PROFILE_CONSOLE 9
+#define PROFILE_TELEMETRY 10
+#define PROFILE_WATCHDOG 11
+#define PROFILE_SLOTS 12
+
+#if PROFILE_ENABLED
+
+typedef struct {
+    long started;
+
+    // Accumulating in the current window
+    long total;
+    int count;
+    int min;
+    int max;
+
+    // Published from the last window
+    int average;    // hundredths of a ms
+    int fastest;    // ms
+    int slowest;    // ms
+    int share;      // tenths of a percent of the CPU, only as good as the times
+    int iterations; // in the window
+} ProfileSlot;
+
+ProfileSlot profileSlots[PROFILE_SLOTS];
+long profileWindowStart = 0;
+int profileWindows = 0; // Incremented every time new figures are published
+
+long profileIdleSpins = 0;     // Counted by profileIdle
+long profileIdleLast = 0;      // profileIdleSpins when the window started
+float profileSpinsPerMs = 0;   // With the CPU to itself, from profileCalibrate
+int profileBusy = 0;           // tenths of a percent of the CPU used by everything but profileIdle, last window
+
+void profileStart(int slot) {
+    profileSlots[slot].started = nSysTime;
+}
+
+void profileStop(int slot) {
+    int elapsed = nSysTime - profileSlots[slot].started;
+
+    profileSlots[slot].total += elapsed;
+    profileSlots[slot].count++;
+    if (profileSlots[slot].count == 1 || elapsed < profileSlots[slot].min) profileSlots[slot].min = elapsed;
+    if (elapsed > profileSlots[slot].max) profileSlots[slot].max = elapsed;
+}
+
+task profileIdle() {
+    while(true) {
+        long until = nSysTime + 10;
+        while(nSysTime < until) profileIdleSpins++; // Same loop as profileCalibrate, so a spin costs the same
+    }
+}
+
+/**
+ * Measures how fast profileIdle spins with nothing else running, then starts it at the lowest priority.
+ * Takes PROFILE_CALIBRATION ms with every other task held, so call once at startup
+ */
+void profileCalibrate() {
+    hogCPU();
+    long until = nSysTime + 1;
+    while(nSysTime < until) {} // Start on a tick
+    until += PROFILE_CALIBRATION;
+    long first = profileIdleSpins;
+    while(nSysTime < until) profileIdleSpins++;
+    releaseCPU();
+
+    profileSpinsPerMs = (float)(profileIdleSpins - first) / PROFILE_CALIBRATION;
+    profileIdleLast = profileIdleSpins;
+    startTask(profileIdle, kLowPriority);
+}
+
+/**
+ * Publishes figures if the window is over. Call once a HAL cycle
+ */
+void profilePublish() {
+    int window = nSysTime - profileWindowStart;
+    if (window < PROFILE_WINDOW) return;
+
+    for(int i = 0; i < PROFILE_SLOTS; i++) {
+        if (profileSlots[i].count > 0) {
+            profileSlots[i].average = profileSlots[i].total * 100 / profileSlots[i].count;
+            profileSlots[i].fastest = profileSlots[i].min;
+            profileSlots[i].slowest = profileSlots[i].max;
+        }
+        profileSlots[i].share = profileSlots[i].total * 1000 / window;
+        profileSlots[i].iterations = profileSlots[i].count;
+
+        profileSlots[i].total = 0;
+        profileSlots[i].count = 0;
+        profileSlots[i].max = 0;
+    }
+
+    if (profileSpinsPerMs > 0) {
+        long spins = profileIdleSpins - profileIdleLast;
+        profileIdleLast = profileIdleSpins;
+        profileBusy = clamp(round(1000 - spins * 1000.0 / (profileSpinsPerMs * window)), 0, 1000);
+    }
+
+    profileWindowStart = nSysTime;
+    profileWindows++;
+}
+
+#define profileBegin(slot) profileStart(slot)
+#define profileEnd(slot) profileStop(slot)
+
+#else
+
+#define profileBegin(slot)
+#define profileEnd(slot)
+#define profilePublish()
+#define profileCalibrate()
+
+#endif
@@ -0,0 +1,139 @@
+/**
+ * sonar.c - Ball presence estimation from the sonar
+ *
+ * Raw sonar readings occasionally echo short (a phantom ball) or drop out (-1). Readings are filtered with a
+ * median over the last SONAR_WINDOW valid pings, and the loaded state has hysteresis: a ball is loaded when the
+ * median falls to loadDistance, and only unloaded once it rises past unloadDistance.
+ *
+ * A ball right against the sensor is too close to echo, and reads 0 or -1. 0 is always taken as a ball. -1 is
+ * taken as a ball while the median says one is close (it came in through near readings), and as a dropout
+ * otherwise.
+ *
+ * The state is only known once the window is full, and stops being known when there has been no valid ping for
+ * maxAge. While it is unknown, loaded keeps its last value, and users must not act on it (the HAL holds the
+ * indexer).
+ *
+ * Detection latency: a change needs a majority of the window, so at 20ms per step a ball is reported
+ * (SONAR_WINDOW / 2 + 1) * 20 = 60ms after it arrives. The measured latency of the last transition is kept in
+ * latency.
+ */
+
+#pragma systemFile
+
+#define SONAR_WINDOW 5
+
+typedef struct {
+    int readings[SONAR_WINDOW]; // Ring buffer of valid pings (cm)
+    int count;                  // Number of valid readings in the buffer
+    int next;
+
+    int median;                 // -1 while the window is empty
+    long lastValid;             // nSysTime of the last valid ping
+    bool known;                 // Whether loaded can be trusted: the window is full and its pings are fresh
+
+    // Tuning
+    int loadDistance;
+    int unloadDistance;
+    int maxAge;                 // ms
+
+    bool loaded;
+    int transitions;
+    long lastTransition;        // nSysTime of the last change in loaded
+
+    bool rawLoaded;             // Unfiltered state of the last valid ping
+    long rawChanged;            // When the unfiltered state last changed
+    int latency;                // ms between the unfiltered state changing and the filtered state following it
+} SonarFilter;
+
+void initSonar(SonarFilter & filter, int loadDistance, int unloadDistance, int maxAge) {
+    filter.count = 0;
+    filter.next = 0;
+    filter.median = -1;
+    filter.lastValid = nSysTime;
+    filter.known = false;
+
+    filter.loadDistance = loadDistance;
+    filter.unloadDistance = unloadDistance;
+    filter.maxAge = maxAge;
+
+    filter.loaded = false;
+    filter.transitions = 0;
+    filter.lastTransition = nSysTime;
+
+    filter.rawLoaded = false;
+    filter.rawChanged = nSysTime;
+    filter.latency = 0;
+}
+
+/**
+ * Median of the buffered readings (insertion sort of a copy, the window is tiny)
+ */
+int sonarMedian(SonarFilter & filter) {
+    int sorted[SONAR_WINDOW];
+    int value, j;
+
+    for(int i = 0; i < filter.count; i++) {
+        value = filter.readings[i];
+        j = i - 1;
+        while(j >= 0 && sorted[j] > value) {
+            sorted[j + 1] = sorted[j];
+            j--;
+        }
+        sorted[j + 1] = value;
+    }
+
+    return sorted[filter.count / 2];
+}
+
+/**
+ * Adds a raw reading and updates the loaded state
+ * @param int raw SensorValue of the sonar, in cm (negative when there was no echo)
+ * @return bool Whether a ball is loaded
+ */
+bool stepSonar(SonarFilter & filter, int raw) {
+    bool wasLoaded = filter.loaded;
+
+    // Too close to echo
+    if (raw < 0 && filter.median >= 0 && filter.median <= filter.unloadDistance) {
+        raw = 0;
+    }
+
+    if (raw >= 0) {
+        if ((raw <= filter.loadDistance) != filter.rawLoaded) {
+            filter.rawLoaded = !filter.rawLoaded;
+            filter.rawChanged = nSysTime;
+        }
+
+        filter.readings[filter.next] = raw;
+        filter.next = (filter.next + 1) % SONAR_WINDOW;
+        if (filter.count < SONAR_WINDOW) filter.count++;
+
+        filter.lastValid = nSysTime;
+        filter.median = sonarMedian(filter);
+
+        // Hysteresis, once there are enough pings for the median to mean something
+        filter.known = filter.count == SONAR_WINDOW;
+        if (filter.known) {
+            if (filter.median <= filter.loadDistance) {
+                filter.loaded = true;
+            } else if (filter.median > filter.unloadDistance) {
+                filter.loaded = false;
+            }
+        }
+    }
+
+    // Nothing valid for too long, start again (loaded is kept, but not known)
+    if (nSysTime - filter.lastValid > filter.maxAge) {
+        filter.count = 0;
+        filter.median = -1;
+        filter.known = false;
+    }
+
+    if (filter.loaded != wasLoaded) {
+        filter.latency = nSysTime - filter.rawChanged;
+        filter.lastTransition = nSysTime;
+        filter.transitions++;
+    }
+
+    return filter.loaded;
+}
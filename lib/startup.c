@@ -0,0 +1,118 @@
+/**
+ * startup.c - Boot sequence
+ *
+ * The gyro calibrates in the background while the LCD selection menus run. RobotC reads 0 until calibration is
+ * over, so the calibration itself is a fixed wait; what is checked is the result. A good calibration reads steady
+ * afterwards, so the gyro is watched for a moment, and if it drifts (the robot was moved, or bumped) it is
+ * calibrated again. If it is still drifting at the timeout, that is shown on the LCD and logged.
+ **/
+
+#pragma systemFile
+
+#include "lcd.c"
+#include "../hal.c"
+#include "memory.c"
+#include "sysid.c"
+
+// How long RobotC takes to calibrate after the sensor is reconfigured (it reads 0 until then)
+#define GYRO_CALIBRATION_TIME 1100
+// After calibrating, the reading may move at most GYRO_CHECK_DRIFT (tenths of a degree) over GYRO_CHECK_TIME
+#define GYRO_CHECK_TIME 300
+#define GYRO_CHECK_DRIFT 3
+// Stop recalibrating after this long, and continue with whatever we have
+#define GYRO_CALIBRATION_TIMEOUT 3000
+
+typedef struct {
+    long bootStart; // nSysTime when pre_auton started
+    long gyroReadyAt;
+    long readyAt;
+
+    int gyroDrift;    // Tenths of a degree the gyro moved over GYRO_CHECK_TIME after its last calibration
+    int gyroAttempts;
+
+    bool gyroReady;
+    bool gyroTimedOut; // Still drifting when we gave up
+} StartupState;
+
+StartupState startup;
+
+task gyroCalibrate() {
+    long start = nSysTime;
+    int first;
+
+    do {
+        // Cycling the sensor type forces RobotC to recalibrate
+        SensorType[gyro] = sensorNone;
+        wait1Msec(50);
+        SensorType[gyro] = sensorGyro;
+        wait1Msec(GYRO_CALIBRATION_TIME);
+
+        first = SensorValue[gyro];
+        wait1Msec(GYRO_CHECK_TIME);
+
+        // The reading wraps every 3600, take the short way round
+        startup.gyroDrift = SensorValue[gyro] - first;
+        if (startup.gyroDrift > 1800) startup.gyroDrift -= 3600;
+        if (startup.gyroDrift < -1800) startup.gyroDrift += 3600;
+        startup.gyroDrift = abs(startup.gyroDrift);
+        startup.gyroAttempts++;
+    } while(startup.gyroDrift > GYRO_CHECK_DRIFT && nSysTime - start < GYRO_CALIBRATION_TIMEOUT);
+
+    startup.gyroTimedOut = startup.gyroDrift > GYRO_CHECK_DRIFT;
+    startup.gyroReadyAt = nSysTime;
+    startup.gyroReady = true;
+}
+
+/**
+ * Starts the background parts of the boot sequence. Call first thing in pre_auton
+ **/
+void startupBegin() {
+    startup.bootStart = nSysTime;
+    startup.gyroReady = false;
+    startup.gyroTimedOut = false;
+    startup.gyroAttempts = 0;
+
+    startTask(gyroCalibrate);
+
+    // Clear flywheel Quad Encoder
+    SensorValue[flywheel] = 0;
+
+    // Clear Drive Encoders
+    SensorValue[leftDrive] = 0;
+    SensorValue[rightDrive] = 0;
+
+    // Controllers are set up now so that the console can tune them before the match (after the encoders are
+    // cleared, so encoder supervision starts from zero)
+    initHAL();
+    initSysId();
+    memoryCheck();
+}
+
+/**
+ * Blocks until the gyro is calibrated, and records the boot-to-ready time
+ **/
+void startupWaitReady() {
+    if (!startup.gyroReady) {
+        displayLCDCenteredString(0, "Calibrating");
+    }
+
+    while(!startup.gyroReady) {
+        wait1Msec(10);
+    }
+
+    startup.readyAt = nSysTime;
+
+    if (startup.gyroTimedOut) {
+        writeDebugStreamLine("GYRO still drifting %d after %d calibrations, keep the robot still and restart",
+            startup.gyroDrift, startup.gyroAttempts);
+        displayLCDCenteredString(0, "GYRO DRIFTING");
+        displayLCDCenteredString(1, "Still + restart");
+        wait1Msec(1500);
+    }
+
+    // Heading starts from the freshly calibrated gyro
+    resetHeading(robot.heading, SensorValue[gyro]);
+
+    writeDebugStreamLine("Boot to ready: %d ms (gyro %d ms, %d calibrations, drift %d)", startup.readyAt - startup.bootStart,
+        startup.gyroReadyAt - startup.bootStart, startup.gyroAttempts, startup.gyroDrift);
+}
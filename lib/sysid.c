@@ -0,0 +1,231 @@
+/**
+ * sysid.c - Drivetrain system identification and feed-forward
+ *
+ * Models each kind of drive motion as
+ *   volts = kS * sgn(velocity) + kV * velocity + kA * acceleration
+ * linear in drive encoder ticks (the average of both sides) and angular in degrees of heading. The models start from
+ * the estimates in robot.c. sysidStart() measures one on the robot: it drives a slow ramp, where acceleration is
+ * negligible so kS and kV dominate, then a sharp step, which brings out kA, each both ways, and fits all the samples
+ * together by least squares. Every sample is also written to the debug stream as CSV, so a run can be checked off
+ * the robot.
+ *
+ * The robot needs clear space: each phase stops after SYSID_MAX_DISTANCE (or a full turn), and the whole run is
+ * abandoned as soon as the driver touches the left stick. Only works while enabled, in driver control.
+ */
+
+#pragma systemFile
+
+#include "../hal.c"
+
+#define SYSID_LINEAR 0
+#define SYSID_ANGULAR 1
+
+#define SYSID_RAMP 1.0          // Quasistatic ramp, volts per second
+#define SYSID_STEP 6.0          // Dynamic step, volts
+#define SYSID_PHASE_TIME 4000   // Longest a phase may run, ms
+#define SYSID_SETTLE 750        // ms to coast to a stop between phases
+#define SYSID_MAX_DISTANCE (48 * DRIVE_TICKS_PER_INCH)
+#define SYSID_MAX_TURN 360
+#define SYSID_MIN_SPEED 20      // Slower samples (units per second) are skipped, the direction of kS is ambiguous at rest
+#define SYSID_MIN_SAMPLES 30
+
+typedef struct {
+    float kS; // volts
+    float kV; // volts per unit per second
+    float kA; // volts per unit per second per second
+} DriveModel;
+
+DriveModel linearModel;  // ticks
+DriveModel angularModel; // degrees
+
+// Normal equations of the least squares fit (row major 3x3, and the right hand side)
+float sysidXTX[9];
+float sysidXTY[3];
+int sysidSamples = 0;
+
+bool sysidRunning = false;
+int sysidMotion = SYSID_LINEAR;
+
+void initSysId() {
+    linearModel.kS = ROBOT_LINEAR_KS;
+    linearModel.kV = ROBOT_LINEAR_KV;
+    linearModel.kA = ROBOT_LINEAR_KA;
+
+    angularModel.kS = ROBOT_ANGULAR_KS;
+    angularModel.kV = ROBOT_ANGULAR_KV;
+    angularModel.kA = ROBOT_ANGULAR_KA;
+}
+
+/**
+ * @param float velocity Units per second
+ * @param float acceleration Units per second per second
+ * @return float The motor power that gives this velocity and acceleration under a model
+ */
+float driveFeedForward(DriveModel & model, float velocity, float acceleration) {
+    float volts = model.kS * sgn(velocity) + model.kV * velocity + model.kA * acceleration;
+    return clamp(volts / batteryVolts() * 127, -127, 127);
+}
+
+/**
+ * @return float Where the drive is, in the units of the motion
+ */
+float sysidPosition(int motion) {
+    if (motion == SYSID_ANGULAR) return robot.heading.angle;
+    return (leftEncoder.position + rightEncoder.position) / 2.0;
+}
+
+void sysidApply(int motion, int power) {
+    robot.leftDrive = motion == SYSID_ANGULAR ? -power : power;
+    robot.rightDrive = power;
+}
+
+void sysidSample(float volts, float velocity, float acceleration) {
+    if (abs(velocity) < SYSID_MIN_SPEED) return;
+
+    float x[3];
+    x[0] = sgn(velocity);
+    x[1] = velocity;
+    x[2] = acceleration;
+
+    for(int i = 0; i < 3; i++) {
+        for(int j = 0; j < 3; j++) {
+            sysidXTX[i * 3 + j] += x[i] * x[j];
+        }
+        sysidXTY[i] += x[i] * volts;
+    }
+
+    sysidSamples++;
+}
+
+float sysidDeterminant(float a, float b, float c, float d, float e, float f, float g, float h, float i) {
+    return a * (e * i - f * h) - b * (d * i - f * g) + c * (d * h - e * g);
+}
+
+/**
+ * Solves the normal equations (Cramer's rule, it's only 3x3)
+ * @return bool Whether the fit is usable, otherwise the model is left alone
+ */
+bool sysidSolve(DriveModel & model) {
+    float det = sysidDeterminant(sysidXTX[0], sysidXTX[1], sysidXTX[2], sysidXTX[3], sysidXTX[4], sysidXTX[5],
+        sysidXTX[6], sysidXTX[7], sysidXTX[8]);
+
+    if (sysidSamples < SYSID_MIN_SAMPLES || det == 0) return false;
+
+    float kS = sysidDeterminant(sysidXTY[0], sysidXTX[1], sysidXTX[2], sysidXTY[1], sysidXTX[4], sysidXTX[5],
+        sysidXTY[2], sysidXTX[7], sysidXTX[8]) / det;
+    float kV = sysidDeterminant(sysidXTX[0], sysidXTY[0], sysidXTX[2], sysidXTX[3], sysidXTY[1], sysidXTX[5],
+        sysidXTX[6], sysidXTY[2], sysidXTX[8]) / det;
+    float kA = sysidDeterminant(sysidXTX[0], sysidXTX[1], sysidXTY[0], sysidXTX[3], sysidXTX[4], sysidXTY[1],
+        sysidXTX[6], sysidXTX[7], sysidXTY[2]) / det;
+
+    // Nothing physical has negative friction or back EMF
+    if (kS < 0 || kV <= 0 || kA < 0) return false;
+
+    model.kS = kS;
+    model.kV = kV;
+    model.kA = kA;
+    return true;
+}
+
+/**
+ * Runs one ramp or step, sampling once per HAL measurement
+ * @param bool ramp Ramp (quasistatic) or step (dynamic)
+ * @param int direction 1 or -1
+ */
+void sysidPhase(int motion, bool ramp, int direction) {
+    float start = sysidPosition(motion);
+    float limit = motion == SYSID_ANGULAR ? SYSID_MAX_TURN : SYSID_MAX_DISTANCE;
+    float lastPosition = start;
+    float lastVelocity = 0;
+    long lastMeasure = robot.lastMeasure;
+    long phaseStart = nSysTime;
+    int power = 0;
+
+    while(sysidRunning && nSysTime - phaseStart < SYSID_PHASE_TIME && abs(lastPosition - start) < limit) {
+        if (abs(vexRT[Ch3]) > 20 || abs(vexRT[Ch4]) > 20) {
+            sysidRunning = false;
+            break;
+        }
+
+        // Wait for the HAL to measure the power we applied last time
+        if (robot.lastMeasure == lastMeasure) {
+            wait1Msec(2);
+            continue;
+        }
+
+        int dt = robot.lastMeasure - lastMeasure;
+        float position = sysidPosition(motion);
+        float velocity = (position - lastPosition) * 1000.0 / dt;
+        float acceleration = (velocity - lastVelocity) * 1000.0 / dt;
+        float volts = power * batteryVolts() / 127;
+
+        sysidSample(volts, velocity, acceleration);
+        writeDebugStreamLine("%d,%d,%.2f,%.1f,%.1f", robot.lastMeasure, motion, volts, velocity, acceleration);
+
+        lastMeasure = robot.lastMeasure;
+        lastPosition = position;
+        lastVelocity = velocity;
+
+        float target = ramp ? SYSID_RAMP * (nSysTime - phaseStart) / 1000.0 : SYSID_STEP;
+        power = direction * clamp(target / batteryVolts() * 127, 0, 127);
+        sysidApply(motion, power);
+    }
+
+    sysidApply(motion, 0);
+    wait1Msec(SYSID_SETTLE);
+}
+
+void sysidReport(DriveModel & model, bool solved) {
+    if (solved) {
+        writeDebugStreamLine("sysid: kS %.3f kV %.5f kA %.5f (%d samples)", model.kS, model.kV, model.kA, sysidSamples);
+    } else {
+        writeDebugStreamLine("sysid: fit failed (%d samples)", sysidSamples);
+    }
+}
+
+task sysidTask() {
+    int motion = sysidMotion;
+    bool traction = leftTraction.enabled;
+
+    // Traction control would bend the ramps and steps
+    leftTraction.enabled = rightTraction.enabled = false;
+    robot.driveOverride = true;
+
+    for(int i = 0; i < 9; i++) sysidXTX[i] = 0;
+    for(int i = 0; i < 3; i++) sysidXTY[i] = 0;
+    sysidSamples = 0;
+
+    writeDebugStreamLine("time,motion,volts,velocity,acceleration");
+
+    sysidPhase(motion, true, 1);
+    sysidPhase(motion, true, -1);
+    sysidPhase(motion, false, 1);
+    sysidPhase(motion, false, -1);
+
+    robot.driveOverride = false;
+    leftTraction.enabled = rightTraction.enabled = traction;
+
+    if (!sysidRunning) {
+        writeDebugStreamLine("sysid: abandoned");
+    } else if (motion == SYSID_ANGULAR) {
+        sysidReport(angularModel, sysidSolve(angularModel));
+    } else {
+        sysidReport(linearModel, sysidSolve(linearModel));
+    }
+
+    sysidRunning = false;
+}
+
+/**
+ * Starts identifying a motion in the background
+ * @param int motion SYSID_LINEAR or SYSID_ANGULAR
+ * @return bool Whether it started (not if already running, or disabled)
+ */
+bool sysidStart(int motion) {
+    if (sysidRunning || bIfiRobotDisabled) return false;
+
+    sysidMotion = motion;
+    sysidRunning = true;
+    startTask(sysidTask);
+    return true;
+}
@@ -27,6 +27,9 @@ typedef struct {
     float Ki;
     float Kd;
 
+    // Errors larger than this (in RPM) use bang bang control instead of TBH
+    float bangBang;
+
     // Error (setpoint - error)
     float error;
 
@@ -44,26 +47,30 @@ typedef struct {
     float maxRPM;
 
     // For calculating the process
-    float deltaTime;
-    float lastTime;
+    int deltaTime;
+    long lastTime;
 
-    float deltaEncoder;
-    float lastEncoder;
+    int deltaEncoder;
+    long lastEncoder;
 
     // Encoder PORT (used to calculate RPM)
     int encoder;
 
-    // Gear Ratio between the encoder and ouput
-    float gearRatio;
+    // Output RPM per encoder tick per ms (gear ratio and unit conversion folded together, see robot.c)
+    float rpmPerTick;
 
 } TBHController;
 
-void initTBH(TBHController & controller, float gain, float maxRPM, int encoder, float gearRatio) {
+/**
+ * @param float rpmPerTick Output RPM per encoder tick per ms, FLYWHEEL_RPM_PER_TICK_MS for the flywheel
+ */
+void initTBH(TBHController & controller, float gain, float maxRPM, int encoder, float rpmPerTick) {
     controller.Ki = gain;
+    controller.bangBang = 750;
     controller.maxRPM = maxRPM;
     controller.lastError = 1;
     controller.encoder = encoder;
-    controller.gearRatio = gearRatio;
+    controller.rpmPerTick = rpmPerTick;
 }
 
 void stepTBH(TBHController & controller) {
@@ -90,9 +97,9 @@ void stepTBH(TBHController & controller) {
     }
 
     // Bang Bang for large enough errors, resetting the integral
-    if (abs(controller.error) > 750) {
+    if (abs(controller.error) > controller.bangBang) {
         controller.output = sgn(controller.error) * 127;
-        controller.integral = 100
+        controller.integral = 100;
     } else {
         controller.output = controller.integral;
     }
@@ -100,9 +107,12 @@ void stepTBH(TBHController & controller) {
     controller.lastError = controller.error;
 
 
-    if (controller.setpoint > 0 || controller.process > 0) { 
+#ifdef TBH_DEBUG_STREAM
+    // Superseded by the telemetry stream, but handy without a UART cable
+    if (controller.setpoint > 0 || controller.process > 0) {
         writeDebugStreamLine("%d, %d, %d", nSysTime, controller.setpoint, controller.process);
     }
+#endif
 }
 
 // Targets Controller
@@ -124,17 +134,25 @@ void targetTBH(TBHController & controller, float setpoint) {
     controller.setpoint = setpoint;
 }
 
-// Calculates the process variable, specifically for RPM
-void calculateProcessTBH(TBHController & controller) {
+// Calculates the process variable, specifically for RPM, from a given encoder count
+void calculateProcessTBHFrom(TBHController & controller, long count) {
     controller.deltaTime = nSysTime - controller.lastTime;
+    if (controller.deltaTime <= 0) {
+        return;
+    }
     controller.lastTime = nSysTime;
 
 
-    controller.deltaEncoder = SensorValue[controller.encoder] - controller.lastEncoder;
-    controller.lastEncoder = SensorValue[controller.encoder];
+    controller.deltaEncoder = count - controller.lastEncoder;
+    controller.lastEncoder = count;
 
 
-    controller.process = (((float)controller.deltaEncoder / (float)controller.deltaTime) * 1000.0 *  controller.gearRatio / 360.0 * 60.0);
+    controller.process = (float)controller.deltaEncoder * controller.rpmPerTick / controller.deltaTime;
 
     
 }
+
+// Calculates the process variable, specifically for RPM
+void calculateProcessTBH(TBHController & controller) {
+    calculateProcessTBHFrom(controller, SensorValue[controller.encoder]);
+}
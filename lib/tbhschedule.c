@@ -0,0 +1,206 @@
+/**
+ * tbhschedule.c - Gain scheduling for the flywheel TBH controller
+ *
+ * No single Ki and bang-bang band suits every setpoint and every battery level. This keeps both in a small table
+ * indexed by setpoint and battery voltage, and interpolates between the cells every step. When the setpoint
+ * changes, TBH's take back half value is started from the learned hold power (see feedforward.c), converted to
+ * power at the present voltage, so the first crossing already lands close to the right output.
+ *
+ * The table learns while shooting. Each recovery (a shot, or the setpoint being raised) is watched until it settles,
+ * and the nearest cell is adjusted: if it overshot past the band, Ki comes down and bang-bang hands over earlier; if
+ * it didn't, both are pushed a little harder. Each cell ends up just short of overshooting, which is as fast as that
+ * setpoint can recover at that voltage. The console prints the tables as commands that load them back in.
+ */
+
+#pragma systemFile
+
+#include "util.c"
+#include "tbh.c"
+#include "feedforward.c"
+
+#define SCHEDULE_RPM_BINS 4
+#define SCHEDULE_RPM_MIN 2000.0
+#define SCHEDULE_RPM_STEP 300.0   // 2000, 2300, 2600, 2900
+#define SCHEDULE_VOLT_BINS 3
+#define SCHEDULE_VOLT_MIN 7.2
+#define SCHEDULE_VOLT_STEP 0.6    // 7.2, 7.8, 8.4
+#define SCHEDULE_CELLS 12         // SCHEDULE_RPM_BINS * SCHEDULE_VOLT_BINS
+
+#define SCHEDULE_DROP 300         // RPM below the setpoint that starts a recovery
+#define SCHEDULE_SETTLE 200       // ms inside the band that ends one
+#define SCHEDULE_TIMEOUT 3000     // ms before a recovery that hasn't settled is given up on (without learning)
+
+#define SCHEDULE_KI_MIN 0.0005
+#define SCHEDULE_KI_MAX 0.004
+#define SCHEDULE_BANG_MIN 200
+#define SCHEDULE_BANG_MAX 1200
+
+typedef struct {
+    // Cells are [rpm bin * SCHEDULE_VOLT_BINS + volt bin]
+    float Ki[SCHEDULE_CELLS];
+    float bangBang[SCHEDULE_CELLS];
+
+    bool enabled;
+    bool learning;
+    int adjustments;
+
+    float lastSetpoint;
+
+    // Recovery being watched
+    long recoveryStart;  // 0 when not recovering
+    long inBandSince;    // 0 when outside the band
+    int cell;            // Nearest cell when it started
+    float overshoot;     // RPM past the setpoint
+} TBHSchedule;
+
+void initSchedule(TBHSchedule & schedule, float Ki, float bangBang) {
+    for(int i = 0; i < SCHEDULE_CELLS; i++) {
+        schedule.Ki[i] = Ki;
+        schedule.bangBang[i] = bangBang;
+    }
+
+    schedule.enabled = true;
+    schedule.learning = true;
+    schedule.adjustments = 0;
+    schedule.lastSetpoint = 0;
+    schedule.recoveryStart = 0;
+}
+
+/**
+ * Sets every cell of one table, for starting the learning over from a flat tuning
+ * @param bool bang The bang-bang table, otherwise Ki
+ */
+void scheduleFill(TBHSchedule & schedule, bool bang, float value) {
+    for(int i = 0; i < SCHEDULE_CELLS; i++) {
+        if (bang) {
+            schedule.bangBang[i] = value;
+        } else {
+            schedule.Ki[i] = value;
+        }
+    }
+}
+
+float scheduleRpmIndex(float setpoint) {
+    return clamp((setpoint - SCHEDULE_RPM_MIN) / SCHEDULE_RPM_STEP, 0, SCHEDULE_RPM_BINS - 1);
+}
+
+float scheduleVoltIndex(float volts) {
+    return clamp((volts - SCHEDULE_VOLT_MIN) / SCHEDULE_VOLT_STEP, 0, SCHEDULE_VOLT_BINS - 1);
+}
+
+float scheduleCell(TBHSchedule & schedule, bool bang, int rpmBin, int voltBin) {
+    int i = rpmBin * SCHEDULE_VOLT_BINS + voltBin;
+    return bang ? schedule.bangBang[i] : schedule.Ki[i];
+}
+
+/**
+ * Bilinear interpolation between the four cells around a setpoint and voltage
+ * @param bool bang The bang-bang table, otherwise Ki
+ */
+float scheduleLookup(TBHSchedule & schedule, bool bang, float setpoint, float volts) {
+    float r = scheduleRpmIndex(setpoint);
+    float v = scheduleVoltIndex(volts);
+    int r0 = r;
+    int v0 = v;
+    int r1 = r0 < SCHEDULE_RPM_BINS - 1 ? r0 + 1 : r0;
+    int v1 = v0 < SCHEDULE_VOLT_BINS - 1 ? v0 + 1 : v0;
+    float fr = r - r0;
+    float fv = v - v0;
+
+    float low = scheduleCell(schedule, bang, r0, v0) * (1 - fv) + scheduleCell(schedule, bang, r0, v1) * fv;
+    float high = scheduleCell(schedule, bang, r1, v0) * (1 - fv) + scheduleCell(schedule, bang, r1, v1) * fv;
+    return low * (1 - fr) + high * fr;
+}
+
+int scheduleNearest(float setpoint, float volts) {
+    int r = scheduleRpmIndex(setpoint) + 0.5;
+    int v = scheduleVoltIndex(volts) + 0.5;
+    return r * SCHEDULE_VOLT_BINS + v;
+}
+
+/**
+ * Adjusts the cell a recovery started in, from how it went
+ * @param int band The error (RPM) considered on target
+ */
+void scheduleLearn(TBHSchedule & schedule, int band) {
+    int i = schedule.cell;
+
+    if (schedule.overshoot > band) {
+        schedule.Ki[i] *= 0.9;
+        schedule.bangBang[i] += 50;
+    } else {
+        schedule.Ki[i] *= 1.05;
+        schedule.bangBang[i] -= 25;
+    }
+
+    schedule.Ki[i] = clamp(schedule.Ki[i], SCHEDULE_KI_MIN, SCHEDULE_KI_MAX);
+    schedule.bangBang[i] = clamp(schedule.bangBang[i], SCHEDULE_BANG_MIN, SCHEDULE_BANG_MAX);
+    schedule.adjustments++;
+
+    writeDebugStreamLine("Schedule cell %d: %d ms, %d over, Ki %.5f bang %d", i, nSysTime - schedule.recoveryStart,
+        (int)schedule.overshoot, schedule.Ki[i], (int)schedule.bangBang[i]);
+}
+
+/**
+ * Schedules the controller's gains, and learns from recoveries. Call before stepTBH
+ * @param FeedForward hold The learned hold voltage by setpoint
+ * @param float volts Battery voltage
+ * @param int band The error (RPM) considered on target
+ * @param bool observe Whether TBH is really in control (don't learn from open loop or held output)
+ */
+void stepSchedule(TBHSchedule & schedule, TBHController & controller, FeedForward & hold, float volts, int band, bool observe) {
+    if (!schedule.enabled) return;
+
+    if (controller.setpoint != schedule.lastSetpoint) {
+        // Take back half towards the power that should hold the new setpoint
+        if (controller.setpoint > 0) {
+            controller.tbh = clamp(feedForward(hold, controller.setpoint) * 127 / volts, -127, 127);
+        }
+
+        // Raising it (properly, not the manual trim) is a recovery too, lowering it isn't interesting
+        schedule.recoveryStart = controller.setpoint - schedule.lastSetpoint > SCHEDULE_DROP ? nSysTime : 0;
+        schedule.cell = scheduleNearest(controller.setpoint, volts);
+        schedule.overshoot = 0;
+        schedule.inBandSince = 0;
+        schedule.lastSetpoint = controller.setpoint;
+    }
+
+    if (controller.setpoint <= 0) return;
+
+    controller.Ki = scheduleLookup(schedule, false, controller.setpoint, volts);
+    controller.bangBang = scheduleLookup(schedule, true, controller.setpoint, volts);
+
+    if (!schedule.learning || !observe) {
+        schedule.recoveryStart = 0;
+        return;
+    }
+
+    float error = controller.setpoint - controller.process;
+
+    if (schedule.recoveryStart == 0) {
+        if (error > SCHEDULE_DROP) {
+            schedule.recoveryStart = nSysTime;
+            schedule.cell = scheduleNearest(controller.setpoint, volts);
+            schedule.overshoot = 0;
+            schedule.inBandSince = 0;
+        }
+        return;
+    }
+
+    if (-error > schedule.overshoot) schedule.overshoot = -error;
+
+    if (abs(error) < band) {
+        if (schedule.inBandSince == 0) schedule.inBandSince = nSysTime;
+    } else {
+        schedule.inBandSince = 0;
+    }
+
+    if (schedule.inBandSince != 0 && nSysTime - schedule.inBandSince >= SCHEDULE_SETTLE) {
+        scheduleLearn(schedule, band);
+        schedule.recoveryStart = 0;
+    } else if (nSysTime - schedule.recoveryStart > SCHEDULE_TIMEOUT) {
+        // Never settled, so there's no telling whether the gains were too high or too low
+        writeDebugStreamLine("Schedule cell %d: no settle in %d ms, not learned", schedule.cell, SCHEDULE_TIMEOUT);
+        schedule.recoveryStart = 0;
+    }
+}
@@ -0,0 +1,248 @@
+/**
+ * telemetry.c - Binary telemetry stream
+ *
+ * Streams robot state over the console UART at up to 100 Hz (enable with the console command "stream <hz>").
+ * While streaming, console replies are sent as TELEMETRY_TEXT frames rather than raw text, and every write to the
+ * port holds telemetryPortLock, so nothing can land in the middle of a frame. A decoder should still scan for the
+ * sync bytes and drop any frame whose checksum doesn't match (text sent before the stream started, line noise).
+ * tools/telemetry.py decodes and plots a capture.
+ *
+ * Frame:
+ *  0xA5 0x5A     Sync
+ *  type          Frame type (TELEMETRY_STATE, TELEMETRY_PROFILE or TELEMETRY_TEXT)
+ *  length        Payload length in bytes
+ *  sequence      Incremented every frame, wraps at 255 (gaps mean dropped frames)
+ *  payload       Little endian fields, see telemetrySendState()
+ *  sum1 sum2     Fletcher-16 over type, length, sequence and payload
+ **/
+
+#pragma systemFile
+
+#include "../hal.c"
+
+#define TELEMETRY_PORT uartTwo
+#define TELEMETRY_SYNC1 0xA5
+#define TELEMETRY_SYNC2 0x5A
+
+#define TELEMETRY_STATE 1
+#define TELEMETRY_STATE_LENGTH 46
+
+#define TELEMETRY_PROFILE 2
+#define TELEMETRY_PROFILE_LENGTH (PROFILE_SLOTS * 8 + 2)
+
+#define TELEMETRY_TEXT 3 // Payload is a console line, without the line ending
+
+#define TELEMETRY_MAX_RATE 100
+
+// ms between frames, 0 when disabled
+int telemetryPeriod = 0;
+int telemetrySequence = 0;
+#if PROFILE_ENABLED
+int telemetryProfileSent = 0; // profileWindows when profile figures were last sent
+#endif
+bool telemetryRunning = false;
+
+// Held for each frame, and by the console for each line, so the two never interleave on the port
+TSemaphore telemetryPortLock;
+
+// Fletcher-16 running sums for the frame being sent
+int telemetrySum1;
+int telemetrySum2;
+
+void telemetryByte(int value) {
+    value &= 0xFF;
+
+    telemetrySum1 = (telemetrySum1 + value) % 255;
+    telemetrySum2 = (telemetrySum2 + telemetrySum1) % 255;
+
+    sendChar(TELEMETRY_PORT, value);
+}
+
+void telemetryShort(int value) {
+    telemetryByte(value);
+    telemetryByte(value >> 8);
+}
+
+void telemetryLong(long value) {
+    telemetryShort(value);
+    telemetryShort(value >> 16);
+}
+
+/**
+ * Call once, before anything writes to the port
+ **/
+void telemetryInit() {
+    semaphoreInitialize(telemetryPortLock);
+}
+
+void telemetryLockPort() {
+    semaphoreLock(telemetryPortLock);
+}
+
+void telemetryUnlockPort() {
+    if (bDoesTaskOwnSemaphore(telemetryPortLock)) semaphoreUnlock(telemetryPortLock);
+}
+
+bool telemetryStreaming() {
+    return telemetryPeriod > 0;
+}
+
+void telemetryBegin(int type, int length) {
+    telemetryLockPort();
+
+    sendChar(TELEMETRY_PORT, TELEMETRY_SYNC1);
+    sendChar(TELEMETRY_PORT, TELEMETRY_SYNC2);
+
+    telemetrySum1 = 0;
+    telemetrySum2 = 0;
+
+    telemetryByte(type);
+    telemetryByte(length);
+    telemetryByte(telemetrySequence);
+    telemetrySequence = (telemetrySequence + 1) & 0xFF;
+}
+
+void telemetryEnd() {
+    int sum1 = telemetrySum1, sum2 = telemetrySum2;
+
+    sendChar(TELEMETRY_PORT, sum1);
+    sendChar(TELEMETRY_PORT, sum2);
+
+    telemetryUnlockPort();
+}
+
+/**
+ * Sends a TELEMETRY_TEXT frame
+ * @param char * text The line
+ * @param int length Its length
+ **/
+void telemetrySendText(char * text, int length) {
+    telemetryBegin(TELEMETRY_TEXT, length);
+
+    for(int i = 0; i < length; i++) {
+        telemetryByte(text[i]);
+    }
+
+    telemetryEnd();
+}
+
+/**
+ * Sends a TELEMETRY_STATE frame. Payload:
+ *  u32 time (ms)
+ *  i16 flywheel setpoint, process, error (RPM)
+ *  i8  flywheel output
+ *  i8  motor[] x10 (port 1 first)
+ *  i8  robot.leftDrive, robot.rightDrive (clamped to the motor range, they run to +/-254)
+ *  i32 left drive, right drive encoder
+ *  i16 heading (tenths of a degree, 0 - 3599 counterclockwise, see heading.c)
+ *  i16 ball detector (cm)
+ *  u8  flags (bit 0 ball loaded, bit 1 firing, bit 2 flywheel control disabled)
+ *  u8  double shot mode, intake, indexer
+ *  u16 battery (mV)
+ *  u8  indexer, intake unjam count
+ *  u16 HAL deadline misses
+ *  u8  degraded modes (see watchdog.c)
+ **/
+void telemetrySendState() {
+    telemetryBegin(TELEMETRY_STATE, TELEMETRY_STATE_LENGTH);
+
+    telemetryLong(nSysTime);
+
+    telemetryShort(robot.flywheel.setpoint);
+    telemetryShort(robot.flywheel.process);
+    telemetryShort(robot.flywheel.error);
+    telemetryByte(robot.flywheel.output);
+
+    for(int i = 0; i < 10; i++) {
+        telemetryByte(motor[i]);
+    }
+    telemetryByte(clamp(robot.leftDrive, -127, 127));
+    telemetryByte(clamp(robot.rightDrive, -127, 127));
+
+    telemetryLong(SensorValue[leftDrive]);
+    telemetryLong(SensorValue[rightDrive]);
+
+    // The heading is continuous, so wrap it to fit however many turns have been made
+    int heading = (long)(robot.heading.angle * 10) % 3600;
+    telemetryShort(heading < 0 ? heading + 3600 : heading);
+    telemetryShort(SensorValue[ballDetector]);
+
+    telemetryByte(
+        (robot.ballLoaded ? 1 : 0) |
+        (robot.firing ? 2 : 0) |
+        (robot.disableFlywheelControl ? 4 : 0)
+    );
+    telemetryByte(robot.doubleShotMode);
+    telemetryByte(robot.intake);
+    telemetryByte(robot.indexer);
+
+    telemetryShort(nImmediateBatteryLevel);
+
+    telemetryByte(robot.indexerJam.jams);
+    telemetryByte(robot.intakeJam.jams);
+
+    telemetryShort(watchdog.misses);
+    telemetryByte(watchdog.degraded);
+
+    telemetryEnd();
+}
+
+#if PROFILE_ENABLED
+/**
+ * Sends a TELEMETRY_PROFILE frame. Payload, for each profile slot (see profile.c):
+ *  u16 average (hundredths of a ms)
+ *  u8  fastest, slowest (ms)
+ *  u16 CPU share (tenths of a percent)
+ *  u16 iterations in the window
+ * then u16 CPU used by every task, from the idle counter (tenths of a percent)
+ **/
+void telemetrySendProfile() {
+    telemetryBegin(TELEMETRY_PROFILE, TELEMETRY_PROFILE_LENGTH);
+
+    for(int i = 0; i < PROFILE_SLOTS; i++) {
+        telemetryShort(profileSlots[i].average);
+        telemetryByte(profileSlots[i].fastest);
+        telemetryByte(profileSlots[i].slowest);
+        telemetryShort(profileSlots[i].share);
+        telemetryShort(profileSlots[i].iterations);
+    }
+    telemetryShort(profileBusy);
+
+    telemetryEnd();
+}
+#endif
+
+task telemetry() {
+    while(true) {
+        if (telemetryPeriod > 0) {
+            profileBegin(PROFILE_TELEMETRY);
+            telemetrySendState();
+
+#if PROFILE_ENABLED
+            // Profile figures only change once a window
+            if (telemetryProfileSent != profileWindows) {
+                telemetryProfileSent = profileWindows;
+                telemetrySendProfile();
+            }
+#endif
+            profileEnd(PROFILE_TELEMETRY);
+
+            wait1Msec(telemetryPeriod);
+        } else {
+            wait1Msec(50);
+        }
+    }
+}
+
+/**
+ * Sets the stream rate, starting the stream if it isn't already running
+ * @param int rate Frames per second, 0 to stop streaming
+ **/
+void telemetryStream(int rate) {
+    telemetryPeriod = rate > 0 ? 1000 / clamp(rate, 1, TELEMETRY_MAX_RATE) : 0;
+
+    if (!telemetryRunning) {
+        telemetryRunning = true;
+        startTask(telemetry);
+    }
+}
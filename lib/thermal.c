@@ -0,0 +1,128 @@
+/**
+ * thermal.c - PTC thermal model
+ *
+ * Every 393 has a PTC fuse that trips when it gets hot, cutting the motor out for several seconds. This estimates
+ * each motor's current from its power, speed and the battery voltage, integrates that into a PTC temperature,
+ * and smoothly limits the motor's power (through motorThermalLimit) before the PTC would trip.
+ *
+ * Model:
+ *  current = (battery * power / 127 - Ke * speed) / R
+ *  dT/dt = (THERMAL_HEAT * current^2 - (T - ambient)) / THERMAL_TAU
+ *
+ * THERMAL_HEAT is chosen so that the PTC hold current settles exactly at the trip temperature
+ */
+
+#pragma systemFile
+
+#include "motor.c"
+
+// 393 motor constants
+#define THERMAL_RESISTANCE 1.5  // Ohms (7.2V / 4.8A stall)
+#define THERMAL_KE 6.65         // Back EMF at free speed, V
+
+// PTC constants
+#define THERMAL_AMBIENT 20.0    // C
+#define THERMAL_TRIP 100.0      // C
+#define THERMAL_HOLD 1.0        // A, the largest current that never trips
+#define THERMAL_TAU 120.0       // s
+#define THERMAL_HEAT ((THERMAL_TRIP - THERMAL_AMBIENT) / (THERMAL_HOLD * THERMAL_HOLD))
+
+// Derating
+#define THERMAL_DERATE_START 75.0 // C, start limiting power above this temperature
+#define THERMAL_DERATE_MIN 40     // Power limit just before the trip temperature
+
+#define THERMAL_NEVER 999.0       // timeToTrip when the present current will never trip the PTC
+
+typedef struct {
+    float temperature; // Estimated PTC temperature, C
+    float current;     // Estimated current, A
+    float timeToTrip;  // Seconds until the PTC trips at the present current
+
+    float speed;       // Speed as a fraction of free speed, in the motor's own direction
+    bool speedKnown;   // Whether speed was measured this step
+} MotorThermal;
+
+MotorThermal motorThermal[10];
+long thermalLastStep = 0;
+
+void thermalInit() {
+    for(int i = 0; i < 10; i++) {
+        motorThermal[i].temperature = THERMAL_AMBIENT;
+        motorThermal[i].current = 0;
+        motorThermal[i].timeToTrip = THERMAL_NEVER;
+        motorThermal[i].speedKnown = false;
+    }
+    thermalLastStep = nSysTime;
+}
+
+/**
+ * Provides the measured speed of a motor for the next thermalStep()
+ * @param int port The motor
+ * @param float speed Speed as a fraction of free speed, in the motor's own direction
+ */
+void thermalSetSpeed(int port, float speed) {
+    motorThermal[port].speed = speed;
+    motorThermal[port].speedKnown = true;
+}
+
+/**
+ * Provides the measured speed of every motor in a group, accounting for reversed members
+ */
+void thermalSetGroupSpeed(MotorGroup & group, float speed) {
+    for(int i = 0; i < group.count; i++) {
+        thermalSetSpeed(group.ports[i], group.reversed[i] ? -speed : speed);
+    }
+}
+
+/**
+ * Updates the thermal model and power limits. Call after motorControlStep()
+ */
+void thermalStep() {
+    float dt = (nSysTime - thermalLastStep) / 1000.0;
+    float battery = nImmediateBatteryLevel / 1000.0;
+    float steady;
+
+    thermalLastStep = nSysTime;
+
+    for(int i = 0; i < 10; i++) {
+        // Without a measurement, guess that the motor is running at half its commanded speed
+        if (!motorThermal[i].speedKnown) {
+            motorThermal[i].speed = motor[i] / 254.0;
+        }
+        motorThermal[i].speedKnown = false;
+
+        motorThermal[i].current = abs(battery * motor[i] / 127.0 - THERMAL_KE * motorThermal[i].speed) / THERMAL_RESISTANCE;
+
+        // Temperature the PTC would settle at with this current
+        steady = THERMAL_AMBIENT + THERMAL_HEAT * motorThermal[i].current * motorThermal[i].current;
+        motorThermal[i].temperature += (steady - motorThermal[i].temperature) * dt / THERMAL_TAU;
+
+        if (steady > THERMAL_TRIP && motorThermal[i].temperature < THERMAL_TRIP) {
+            motorThermal[i].timeToTrip = -THERMAL_TAU * log((steady - THERMAL_TRIP) / (steady - motorThermal[i].temperature));
+        } else if (motorThermal[i].temperature >= THERMAL_TRIP) {
+            motorThermal[i].timeToTrip = 0;
+        } else {
+            motorThermal[i].timeToTrip = THERMAL_NEVER;
+        }
+
+        // Derate linearly from full power at THERMAL_DERATE_START down to THERMAL_DERATE_MIN at the trip point
+        if (motorThermal[i].temperature > THERMAL_DERATE_START) {
+            motorThermalLimit[i] = clamp(
+                127 - (127 - THERMAL_DERATE_MIN) * (motorThermal[i].temperature - THERMAL_DERATE_START) / (THERMAL_TRIP - THERMAL_DERATE_START),
+                THERMAL_DERATE_MIN, 127);
+        } else {
+            motorThermalLimit[i] = 127;
+        }
+    }
+}
+
+/**
+ * @return int The motor closest to tripping
+ */
+int thermalHottest() {
+    int hottest = 0;
+    for(int i = 1; i < 10; i++) {
+        if (motorThermal[i].temperature > motorThermal[hottest].temperature) hottest = i;
+    }
+    return hottest;
+}
@@ -0,0 +1,57 @@
+/**
+ * traction.c - Traction control for the drive
+ *
+ * Compares the commanded power against how fast the wheels are actually turning (expressed in the same units),
+ * and keeps the command from getting more than slipMargin ahead of the wheels while speeding up. Power ramps
+ * from standstill at no more than maxAccel. Slowing down, braking and reversing are never limited.
+ */
+
+#pragma systemFile
+
+#include "util.c"
+
+typedef struct {
+    bool enabled;
+
+    float maxAccel; // Largest increase in power per ms
+    int slipMargin; // How far power may lead the measured speed, in power units
+
+    float output;
+    long lastTime;
+} TractionController;
+
+void initTraction(TractionController & controller, float maxAccel, int slipMargin) {
+    controller.enabled = false;
+    controller.maxAccel = maxAccel;
+    controller.slipMargin = slipMargin;
+    controller.output = 0;
+    controller.lastTime = nSysTime;
+}
+
+/**
+ * @param int command The power requested
+ * @param int measured The measured wheel speed, scaled so that 127 is free speed
+ * @return int The power to apply
+ */
+int stepTraction(TractionController & controller, int command, int measured) {
+    int dt = clamp(nSysTime - controller.lastTime, 1, 100);
+    controller.lastTime = nSysTime;
+
+    // Only limit when speeding up in the same direction (or from a stop)
+    if (!controller.enabled || abs(command) <= abs(controller.output) || sgn(command) == -sgn(controller.output)) {
+        controller.output = command;
+        return command;
+    }
+
+    float limit = abs(controller.output) + controller.maxAccel * dt;
+
+    // Power may lead the wheels (if they are moving this way at all) by the slip margin
+    float slip = controller.slipMargin + (sgn(measured) == sgn(command) ? abs(measured) : 0);
+    if (limit > slip) limit = slip;
+
+    // Never go backwards from what we already had
+    if (limit < abs(controller.output)) limit = abs(controller.output);
+
+    controller.output = sgn(command) * clamp(abs(command), 0, limit);
+    return controller.output;
+}
@@ -6,6 +6,8 @@
 
 #define arraySize(a) (sizeof(a)/sizeof(a[0]))
 #define PI 3.1415926535
+#define RADIANS_PER_DEGREE (PI / 180.0)
+#define DEGREES_PER_RADIAN (180.0 / PI)
 
 /**
  * Performs modulus for floats
@@ -34,7 +36,14 @@ float clamp(float val, float min, float max) {
  * @param int max The absolute magnitude of the value (direction ambivelant)
  */
 float clampAbs(int val, int max) {
-  return abs(val) > abs(max) ? max * sgn(val) : val
+  return abs(val) > abs(max) ? max * sgn(val) : val;
+}
+
+/**
+ * @return float The (averaged) main battery voltage
+ */
+float batteryVolts() {
+  return nAvgBatteryLevel / 1000.0;
 }
 
 /**
@@ -75,50 +84,73 @@ int rescaleTo(int max, int alpha, int beta, int side) {
 
 
 
-#define STRTOK_MAX_TOKEN_SIZE 20
-#define STRTOK_MAX_BUFFER_SIZE 50
+/**
+ * Finds the next token in a buffer, without copying anything
+ * Usage:
+ *  int position = 0, start, length;
+ *  while((length = nextToken(line, position, start, ' ')) > 0) {
+ *    ...
+ *  }
+ *
+ * @param char * buffer The buffer to search, terminated with a 0
+ * @param int position Where to start searching from, updated to just past the token
+ * @param int start Set to the index of the first character of the token
+ * @param char separator The character between tokens (repeated separators are skipped)
+ * @return int The length of the token, 0 if there are no tokens left
+ */
+int nextToken(char * buffer, int & position, int & start, char separator) {
+  while(buffer[position] == separator) position++;
+
+  start = position;
+  while(buffer[position] != 0 && buffer[position] != separator) position++;
+
+  return position - start;
+}
 
 /**
- * Tokenise an array of chars, using a seperator
- * @param buffer pointer to buffer we're parsing
- * @param token pointer to buffer to hold the tokens as we find them
- * @param seperator the seperator used between tokens
- * @return true if there are still tokens left, false if we're done
+ * Compares a token (see nextToken) to a word
+ * @return bool Whether the token and the word are identical
  */
-bool strtok(char *buffer, char *token, char *seperator)
-{
-  int pos = stringFind(buffer, seperator);
-  char t_buff[STRTOK_MAX_BUFFER_SIZE];
-
-  // Make sure we zero out the buffer and token
-  memset(token, 0, STRTOK_MAX_TOKEN_SIZE);
-  memset(&t_buff[0], 0, STRTOK_MAX_BUFFER_SIZE);
-
-  // Looks like we found a seperator
-  if (pos >= 0)
-  {
-    // Copy the first token into the token buffer, only if the token is
-    // not an empty one
-    if (pos > 0)
-      memcpy(token, buffer, pos);
-    // Now copy characters -after- the seperator into the temp buffer
-    memcpy(&t_buff[0], buffer+(pos+1), strlen(buffer) - pos);
-    // Zero out the real buffer
-    memset(buffer, 0, strlen(buffer) + 1);
-    // Copy the temp buffer, which now only contains everything after the previous
-    // token into the buffer for the next round.
-    memcpy(buffer, &t_buff[0], strlen(&t_buff[0]));
-    return true;
+bool tokenEquals(char * buffer, int start, int length, char * word) {
+  for(int i = 0; i < length; i++) {
+    if (buffer[start + i] != word[i]) return false;
   }
-  // We found no seperator but the buffer still contains a string
-  // This can happen when there is no trailing seperator
-  else if(strlen(buffer) > 0)
-  {
-    // Copy the token into the token buffer
-    memcpy(token, buffer, strlen(buffer));
-    // Zero out the remainder of the buffer
-    memset(buffer, 0, strlen(buffer) + 1);
-    return true;
+  return word[length] == 0;
+}
+
+/**
+ * Parses a token (see nextToken) as a decimal number, like "-12" or "0.0015"
+ * @param float value Set to the parsed value
+ * @return bool Whether the token was a valid number
+ */
+bool tokenToFloat(char * buffer, int start, int length, float & value) {
+  float result = 0;
+  float place = 0; // Value of the current digit after the decimal point, 0 before it
+  bool negative = false;
+  bool digits = false;
+
+  for(int i = start; i < start + length; i++) {
+    char c = buffer[i];
+
+    if (c == '-' && i == start) {
+      negative = true;
+    } else if (c == '.' && place == 0) {
+      place = 0.1;
+    } else if (c >= '0' && c <= '9') {
+      digits = true;
+      if (place == 0) {
+        result = result * 10 + (c - '0');
+      } else {
+        result += (c - '0') * place;
+        place /= 10;
+      }
+    } else {
+      return false;
+    }
   }
-  return false;
+
+  if (!digits) return false;
+
+  value = negative ? -result : result;
+  return true;
 }
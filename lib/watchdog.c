@@ -0,0 +1,117 @@
+/**
+ * watchdog.c - Control loop watchdog and degraded modes
+ *
+ * The HAL calls watchdogHeartbeat() at the start of every cycle. Cycles that start late are counted as deadline
+ * misses. If the HAL stops altogether, the watchdog task (running at high priority) takes over the motors: each
+ * port is clamped to its watchdogHold power (0 for everything except the flywheel, which is held open loop so it
+ * spins down gently instead of staying at full power). The HAL gets the motors back as soon as it runs again.
+ *
+ * Sensor loss doesn't need the HAL to stop, so it is checked from the HAL each cycle (encoders by encoder.c), and
+ * reported through watchdog.degraded for the HAL to act on.
+ */
+
+#pragma systemFile
+
+#include "motor.c"
+
+#define WATCHDOG_PERIOD 10        // ms between checks
+#define WATCHDOG_DEADLINE 30      // ms allowed between HAL cycles before it counts as a miss
+#define WATCHDOG_STALL 100        // ms without a HAL cycle before the watchdog takes over the motors
+
+#define WATCHDOG_SONAR_LOST 500   // ms without a valid ping before the sonar is considered lost
+
+// Degraded modes (watchdog.degraded)
+#define DEGRADED_FLYWHEEL 1 // Flywheel encoder can't be trusted, run from the feed-forward table
+#define DEGRADED_INDEXER 2  // Ball detector can't be trusted, lock the indexer
+#define DEGRADED_DRIVE 4    // HAL stalled, drive stopped
+#define DEGRADED_ODOMETRY 8 // A drive encoder can't be trusted, measuring from the other side
+#define DEGRADED_GYRO 16    // Gyro disagrees with the drive encoders, heading from the encoders (see heading.c)
+
+typedef struct {
+    long lastCycle;
+    int misses;
+    int worstCycle; // ms
+
+    bool stalled;
+    int stalls;
+
+    int degraded;
+} Watchdog;
+
+Watchdog watchdog;
+
+// Largest power each port may run at while the HAL is stalled
+int watchdogHold[10] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+
+bool watchdogRunning = false;
+
+/**
+ * Call at the start of every HAL cycle
+ */
+void watchdogHeartbeat() {
+    int cycle = nSysTime - watchdog.lastCycle;
+
+    if (watchdog.lastCycle != 0) {
+        if (cycle > watchdog.worstCycle) watchdog.worstCycle = cycle;
+
+        if (cycle > WATCHDOG_DEADLINE) {
+            watchdog.misses++;
+            writeDebugStreamLine("Deadline miss %d: %d ms", watchdog.misses, cycle);
+        }
+    }
+
+    watchdog.lastCycle = nSysTime;
+}
+
+void watchdogSetDegraded(int mode, bool on) {
+    if (on && !(watchdog.degraded & mode)) {
+        watchdog.degraded |= mode;
+        writeDebugStreamLine("Degraded: %d", watchdog.degraded);
+    } else if (!on && (watchdog.degraded & mode)) {
+        watchdog.degraded &= ~mode;
+        writeDebugStreamLine("Recovered: %d", watchdog.degraded);
+    }
+}
+
+/**
+ * Checks sensors for loss. Call every HAL cycle
+ * @param bool flywheelEncoder Whether the flywheel encoder is healthy
+ * @param bool driveEncoders Whether both drive encoders are healthy
+ * @param long sonarLastValid nSysTime of the last valid sonar ping
+ */
+void watchdogSensors(bool flywheelEncoder, bool driveEncoders, long sonarLastValid) {
+    watchdogSetDegraded(DEGRADED_FLYWHEEL, !flywheelEncoder);
+    watchdogSetDegraded(DEGRADED_ODOMETRY, !driveEncoders);
+    watchdogSetDegraded(DEGRADED_INDEXER, nSysTime - sonarLastValid > WATCHDOG_SONAR_LOST);
+}
+
+task watchdogTask() {
+    while(true) {
+        profileBegin(PROFILE_WATCHDOG);
+        if (watchdog.lastCycle != 0 && nSysTime - watchdog.lastCycle > WATCHDOG_STALL) {
+            if (!watchdog.stalled) {
+                watchdog.stalled = true;
+                watchdog.stalls++;
+                watchdogSetDegraded(DEGRADED_DRIVE, true);
+                writeDebugStreamLine("HAL stalled (%d)", watchdog.stalls);
+            }
+
+            for(int i = 0; i < 10; i++) {
+                motor[i] = clampAbs(motor[i], watchdogHold[i]);
+            }
+        } else if (watchdog.stalled) {
+            watchdog.stalled = false;
+            watchdogSetDegraded(DEGRADED_DRIVE, false);
+        }
+        profileEnd(PROFILE_WATCHDOG);
+
+        wait1Msec(WATCHDOG_PERIOD);
+    }
+}
+
+void watchdogStart() {
+    if (watchdogRunning) return;
+
+    watchdogRunning = true;
+    startTask(watchdogTask, kHighPriority);
+}
@@ -1,5 +1,5 @@
 #pragma config(UART_Usage, UART1, uartVEXLCD, baudRate19200, IOPins, None, None)
-#pragma config(UART_Usage, UART2, uartNotUsed, baudRate4800, IOPins, None, None)
+#pragma config(UART_Usage, UART2, uartUserControl, baudRate115200, IOPins, None, None)
 #pragma config(Sensor, in1,    gyro,           sensorGyro)
 #pragma config(Sensor, in2,    powerExpander,  sensorAnalog)
 #pragma config(Sensor, dgtl3,  flywheel,       sensorQuadEncoder)
@@ -40,6 +40,9 @@
 #include "lib\motor.c"
 #include "lib\pid.c"
 #include "lib\auton.c"
+#include "lib\mode.c"
+#include "lib\startup.c"
+#include "lib\console.c"
 
 void pre_auton() {
   // Set bStopTasksBetweenModes to false if you want to keep user created tasks
@@ -48,26 +51,20 @@ void pre_auton() {
   bStopTasksBetweenModes = false;
   bDisplayCompetitionStatusOnLcd = false;
 
-  SensorType[gyro] = sensorNone;
-  lcdStartup();
-  SensorType[gyro] = sensorGyro;
-  wait1Msec(2000);
-
-  // Clear flywheel Quad Encoder
-  SensorValue[flywheel] = 0;
+  consoleStart();
 
-  // Clear Drive Encoders
-  SensorValue[leftDrive] = 0;
-  SensorValue[rightDrive] = 0;
+  // Gyro calibrates while the menus are up
+  startupBegin();
+  lcdStartup();
+  startupWaitReady();
 
-  startTask(lcdDebug);
+  lcdDebugStart();
 
 }
 
 task autonomous() {
 
-	startTask(hardwareAbstractionLayer);
-  startTask(lcdDebug);
+  modeEnterAutonomous();
 
   switch(match.auton) {
     case 0:
@@ -85,9 +82,7 @@ task autonomous() {
 
 task usercontrol() {
 
-  startTask(hardwareAbstractionLayer);
-  startTask(lcdDebug);
-
+  modeEnterDriver();
 
   while (true) {
     wait1Msec(20);
@@ -0,0 +1,52 @@
+/**
+ * Robot Profile
+ *
+ * Everything physical about the robot (wheel sizes, gear ratios, reversals and starting gains) lives here, and every
+ * conversion factor the HAL uses is derived from it as a constant expression, so the compiler folds them and nothing
+ * is recomputed while running.
+ *
+ * These are the competition robot's, the only one this code is built for. Motor and sensor ports come from the
+ * #pragma config block in main.c, as RobotC only reads it from the main file.
+ */
+
+#include "lib\util.c"
+
+// Competition robot: 4" wheels with the encoders on the axles
+#define ROBOT_DRIVE_WHEEL_DIAMETER 4.0
+#define ROBOT_DRIVE_ENCODER_RATIO 1.0
+#define ROBOT_DRIVE_FREE_RPM 240.0
+#define ROBOT_DRIVE_TRACK_WIDTH 13.0
+#define ROBOT_DRIVE_LEFT_REVERSED false
+#define ROBOT_DRIVE_RIGHT_REVERSED true   // The right side is mounted mirrored, so it is INTENTIONALLY reversed
+
+#define ROBOT_FLYWHEEL_RATIO 5.0
+#define ROBOT_FLYWHEEL_MAX_RPM 3500.0
+#define ROBOT_FLYWHEEL_KI 0.0015
+
+#define ROBOT_DRIVE_KP 1.6
+#define ROBOT_TURN_KP 1.0
+
+// Drive feed-forward (see sysid.c), estimated from free speed until measured
+#define ROBOT_LINEAR_KS 0.8               // volts
+#define ROBOT_LINEAR_KV 0.005             // volts per tick per second
+#define ROBOT_LINEAR_KA 0.001             // volts per tick per second per second
+#define ROBOT_ANGULAR_KS 1.0              // volts
+#define ROBOT_ANGULAR_KV 0.016            // volts per degree per second
+#define ROBOT_ANGULAR_KA 0.002            // volts per degree per second per second
+
+
+// Derived constants (all folded at compile time)
+
+#define ENCODER_TICKS 360.0
+
+// Drive encoder ticks per inch travelled
+#define DRIVE_TICKS_PER_INCH (ENCODER_TICKS * ROBOT_DRIVE_ENCODER_RATIO / (ROBOT_DRIVE_WHEEL_DIAMETER * PI))
+#define DRIVE_INCHES_PER_TICK (1.0 / DRIVE_TICKS_PER_INCH)
+
+// Drive encoder speed at motor free speed, ticks per second
+#define DRIVE_FREE_SPEED (ROBOT_DRIVE_FREE_RPM * ENCODER_TICKS / 60.0)
+
+#define DRIVE_TRACK_WIDTH ROBOT_DRIVE_TRACK_WIDTH
+
+// Flywheel RPM from flywheel encoder ticks per ms
+#define FLYWHEEL_RPM_PER_TICK_MS (1000.0 * 60.0 * ROBOT_FLYWHEEL_RATIO / ENCODER_TICKS)
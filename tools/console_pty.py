@@ -0,0 +1,79 @@
+#!/usr/bin/env python3
+"""
+Stands in for the robot on the console cable: runs the robot program on the PC (tools/host/console.cpp) with UART2 on
+a pseudo terminal, so the console and anything built on it (tools/telemetry.py captures) can be tried without a robot.
+
+    python3 tools/console_pty.py        # prints the device to open (like /dev/pts/4), runs until interrupted
+
+The HAL runs in real time against the simulated flywheel, so "spin 2500" and "stream 50" behave much like the robot.
+Needs g++, and a system with pseudo terminals (Linux, macOS).
+"""
+
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+import tty
+
+import sim
+
+
+class Console(object):
+    """The stand-in, running until close()"""
+
+    def __init__(self):
+        self.directory = tempfile.mkdtemp()
+        binary = sim.build(self.directory, "console", "main.c")
+
+        master, self.port = os.openpty()
+        tty.setraw(self.port)
+        self.path = os.ttyname(self.port)
+        self.process = subprocess.Popen([binary], stdin=master, stdout=master, stderr=subprocess.DEVNULL)
+        os.close(master)
+        self.pending = b""
+
+    def send(self, line):
+        os.write(self.port, (line + "\r\n").encode())
+
+    def read_line(self, timeout=2.0):
+        """The next line from the robot, without its line ending, or None if nothing came"""
+        deadline = time.time() + timeout
+        while b"\r\n" not in self.pending:
+            if time.time() > deadline:
+                return None
+            os.set_blocking(self.port, False)
+            try:
+                self.pending += os.read(self.port, 256)
+            except BlockingIOError:
+                time.sleep(0.01)
+        line, self.pending = self.pending.split(b"\r\n", 1)
+        return line.decode()
+
+    def command(self, line):
+        """Sends a command and returns the first line of the reply"""
+        self.send(line)
+        return self.read_line()
+
+    def close(self):
+        self.process.terminate()
+        self.process.wait()
+        os.close(self.port)
+        shutil.rmtree(self.directory)
+
+
+def main():
+    console = Console()
+    print("Robot console on %s (Ctrl-C to stop)" % console.path)
+    try:
+        console.process.wait()
+    except KeyboardInterrupt:
+        pass
+    finally:
+        console.close()
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
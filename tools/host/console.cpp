@@ -0,0 +1,46 @@
+/**
+ * console.cpp - The serial console (console.c) on a PC, standing in for the robot on the other end of the cable
+ *
+ * UART2 is stdin and stdout, without blocking; tools/console_pty.py puts them on a pseudo terminal, so anything that
+ * talks to the robot's console (a terminal, a telemetry capture) can talk to this instead. The HAL runs in real time
+ * against the simulated flywheel (plant.h), so "spin" and "stream" show something. The debug stream goes to stderr.
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "robotc.h"
+#include "ports.h"
+
+// The whole robot program, main.c with its includes in place, once each (see tools/sim.py). Only the console and the
+// HAL are ever run
+#define PROFILE_ENABLED 0
+#include "main.c"
+
+#include "plant.h"
+
+int main() {
+    fcntl(0, F_SETFL, fcntl(0, F_GETFL) | O_NONBLOCK);
+    robotcDebugStream = stderr;
+
+    // Nothing in front of the ball detector
+    SensorValue[ballDetector] = 30;
+
+    initHAL();
+    telemetryInit();
+    long lastFrame = 0;
+
+    while(!robotcPortClosed) {
+        plantCycle();
+        consolePoll();
+
+        // The telemetry task, at whole HAL cycles
+        if (telemetryPeriod > 0 && nSysTime - lastFrame >= telemetryPeriod) {
+            lastFrame = nSysTime;
+            telemetrySendState();
+        }
+
+        usleep(HAL_PERIOD * 1000);
+    }
+    return 0;
+}
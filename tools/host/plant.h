@@ -0,0 +1,173 @@
+/**
+ * plant.h - The simulated flywheel and drive, for the host programs. Include after the robot code
+ *
+ * First order: each heads for a speed proportional to motor power and battery voltage, with a time constant. The
+ * defaults are a rough fit to the competition flywheel's spin up and the drive's free speed, not a measurement, so
+ * runs are for comparing one version of the code with another rather than predicting the robot. The drive can also be
+ * pushed, and any encoder can lose a channel.
+ *
+ * Balls run down a single track from the intake mouth: the intake rollers move them up to the indexer, the indexer
+ * from there to the flywheel, which takes them and loses some speed. The ball detector sees the front ball from
+ * BALL_DETECTOR until the flywheel has it. Balls can't pass each other, so one held at the detector holds up the rest.
+ */
+
+#ifndef PLANT_H
+#define PLANT_H
+
+#define HAL_PERIOD 20 // ms, as in hardwareAbstractionLayer
+#define PLANT_NOMINAL_VOLTS 7.8
+
+typedef struct {
+    float freeRPM;      // At 127 and PLANT_NOMINAL_VOLTS
+    float timeConstant; // ms
+    float rpm;
+    float ticks;        // Encoder count, with the fraction not counted yet
+} FlywheelPlant;
+
+FlywheelPlant plant = { 3600, 350, 0, 0 };
+
+typedef struct {
+    float timeConstant; // ms
+    float push;         // Ticks per ms the robot is being pushed forward at, on top of its own speed
+    float speed[2];     // Left and right, ticks per ms
+    float ticks[2];
+} DrivePlant;
+
+DrivePlant drivePlant = { 150, 0, { 0, 0 }, { 0, 0 } };
+
+#define BALL_MAX 16
+#define BALL_SIZE 4.0           // in
+#define BALL_INDEXER 12.0       // in from the intake mouth to the indexer rollers
+#define BALL_DETECTOR 15.0      // The detector sees a ball from here
+#define BALL_FLYWHEEL 17.0      // until the flywheel takes it here, less than a ball on so it sees gaps
+#define BALL_INTAKE_SPEED 0.03  // in per ms at 127
+#define BALL_INDEXER_SPEED 0.02
+#define BALL_SEEN 5             // cm, the detector's reading with a ball in front of it
+#define BALL_UNSEEN 30
+
+typedef struct {
+    float x[BALL_MAX];      // Balls in the robot, front first (in from the intake mouth)
+    float rpm[BALL_MAX];    // Speed each takes from the flywheel
+    int count;
+    float waiting[BALL_MAX]; // Balls at the mouth, not in yet (their rpm)
+    int waitingCount;
+    bool used;              // The scenario has balls, so they drive the detector
+    int shots;
+} BallPlant;
+
+BallPlant balls;
+
+/**
+ * A ball reaches the intake mouth, and will take rpm from the flywheel when shot
+ */
+void ballArrive(float rpm) {
+    balls.used = true;
+    if (balls.waitingCount < BALL_MAX) {
+        balls.waiting[balls.waitingCount++] = rpm;
+    }
+}
+
+// Encoders that have lost a channel, and only count up
+bool encoderOneWay[20];
+float encoderSeen[20];      // Where the mechanism was at the last reading, ticks
+float encoderFraction[20];  // Counted but not a whole tick yet
+
+/**
+ * Counts the encoder on port for a mechanism now at ticks, from whatever the robot code has it at
+ */
+void plantEncoder(int port, float ticks) {
+    float change = ticks - encoderSeen[port];
+    encoderSeen[port] = ticks;
+    if (encoderOneWay[port]) {
+        change = fabs(change);
+    }
+
+    float count = SensorValue[port] + encoderFraction[port] + change;
+    SensorValue[port] = (int)floor(count);
+    encoderFraction[port] = count - SensorValue[port];
+}
+
+float plantVolts() {
+    return nImmediateBatteryLevel / 1000.0 / PLANT_NOMINAL_VOLTS;
+}
+
+/**
+ * Moves the balls for a millisecond on the intake and indexer power, the flywheel taking any that reach it. The
+ * scenarios never run either roller out, so balls only move in
+ */
+void ballStep() {
+    if (!balls.used) {
+        return;
+    }
+
+    float intake = fmax(0, -motor[Intake]) / 127.0 * BALL_INTAKE_SPEED * plantVolts();
+    float indexer = fmax(0, motor[Indexer]) / 127.0 * BALL_INDEXER_SPEED * plantVolts();
+
+    float limit = BALL_FLYWHEEL + BALL_SIZE;
+    for(int i = 0; i < balls.count; i++) {
+        float x = balls.x[i] + (balls.x[i] < BALL_INDEXER ? intake : indexer);
+        balls.x[i] = fmin(x, limit);
+        limit = balls.x[i] - BALL_SIZE;
+    }
+
+    while(balls.count > 0 && balls.x[0] >= BALL_FLYWHEEL) {
+        plant.rpm -= balls.rpm[0];
+        balls.shots++;
+        balls.count--;
+        for(int i = 0; i < balls.count; i++) {
+            balls.x[i] = balls.x[i + 1];
+            balls.rpm[i] = balls.rpm[i + 1];
+        }
+    }
+
+    // The next ball at the mouth comes in once the intake pulls and there is room
+    if (balls.waitingCount > 0 && intake > 0 && balls.count < BALL_MAX &&
+        (balls.count == 0 || balls.x[balls.count - 1] >= BALL_SIZE)) {
+        balls.x[balls.count] = 0;
+        balls.rpm[balls.count] = balls.waiting[0];
+        balls.count++;
+        balls.waitingCount--;
+        for(int i = 0; i < balls.waitingCount; i++) {
+            balls.waiting[i] = balls.waiting[i + 1];
+        }
+    }
+
+    SensorValue[ballDetector] = balls.count > 0 && balls.x[0] >= BALL_DETECTOR ? BALL_SEEN : BALL_UNSEEN;
+}
+
+/**
+ * Runs the plant for a millisecond on the power the motors are at, and counts the encoders
+ */
+void plantStep() {
+    float target = motor[FlywheelOut] / 127.0 * plant.freeRPM * plantVolts();
+    plant.rpm += (target - plant.rpm) / plant.timeConstant;
+    plant.ticks += plant.rpm / FLYWHEEL_RPM_PER_TICK_MS;
+    plantEncoder(flywheel, plant.ticks);
+
+    int power[2] = {
+        ROBOT_DRIVE_LEFT_REVERSED ? -motor[DriveFL] : motor[DriveFL],
+        ROBOT_DRIVE_RIGHT_REVERSED ? -motor[DriveFR] : motor[DriveFR]
+    };
+    int encoders[2] = { leftDrive, rightDrive };
+    for(int side = 0; side < 2; side++) {
+        target = power[side] / 127.0 * DRIVE_FREE_SPEED / 1000.0 * plantVolts();
+        drivePlant.speed[side] += (target - drivePlant.speed[side]) / drivePlant.timeConstant;
+        drivePlant.ticks[side] += drivePlant.speed[side] + drivePlant.push;
+        plantEncoder(encoders[side], drivePlant.ticks[side]);
+    }
+
+    ballStep();
+}
+
+/**
+ * Runs the plant up to the next HAL cycle, then the cycle
+ */
+void plantCycle() {
+    nSysTime += HAL_PERIOD;
+    for(int i = 0; i < HAL_PERIOD; i++) {
+        plantStep();
+    }
+    halStep();
+}
+
+#endif
@@ -0,0 +1,143 @@
+/**
+ * robotc.h - Just enough of RobotC to build the HAL on a PC
+ *
+ * The robot code is compiled as C++ (g++ -std=gnu++98 -fpermissive), since RobotC passes structs by reference and
+ * C++ is the closest match. Ports are named by ports.h, which tools/sim.py generates from the #pragma config block in
+ * main.c. Only what the robot program uses is here, so anything new it starts using fails to build until it is added.
+ * The LCD is blank and tasks never run: the host programs step the HAL and the console themselves.
+ */
+
+#ifndef ROBOTC_H
+#define ROBOTC_H
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// util.c has its own, which would clash with the C library's
+#define fmodf robotc_fmodf
+
+// RobotC's long is 32 bits, like its int (and the debug stream prints longs with %d)
+#define long int
+
+typedef signed char byte;
+typedef unsigned char ubyte;
+typedef char string[20];
+
+#define task void
+#define kLowPriority 0
+#define kHighPriority 255
+
+// Time, advanced by the simulator (and by anything that waits)
+long nSysTime = 0;
+
+inline void wait1Msec(long ms) {
+    nSysTime += ms;
+}
+
+// Tasks don't run on the host, the simulator steps the HAL itself
+#define startTask(...)
+#define stopTask(...)
+inline void hogCPU() {}
+inline void releaseCPU() {}
+
+// Ports
+int motor[10];
+int SensorValue[20];
+int SensorType[20];
+
+enum TSensorTypes {
+    sensorNone,
+    sensorAnalog,
+    sensorGyro,
+    sensorQuadEncoder,
+    sensorSONAR_cm
+};
+
+// Joystick, indexed like vexRT
+enum TVexJoysticks {
+    Ch1, Ch2, Ch3, Ch4,
+    Btn5D, Btn5U, Btn6D, Btn6U,
+    Btn7D, Btn7L, Btn7R, Btn7U,
+    Btn8D, Btn8L, Btn8R, Btn8U,
+    kNumbOfVexRFIndices
+};
+
+int vexRT[kNumbOfVexRFIndices];
+
+// Field control and battery (mV)
+bool bIfiAutonomousMode = false;
+bool bIfiRobotDisabled = false;
+bool bStopTasksBetweenModes = true;
+bool bDisplayCompetitionStatusOnLcd = true;
+int nAvgBatteryLevel = 7800;
+int nImmediateBatteryLevel = 7800;
+int BackupBatteryLevel = 9000;
+
+// LCD, with nothing on it and no buttons pressed
+enum TControllerButtons { kButtonNone = 0, kButtonLeft = 1, kButtonCenter = 2, kButtonRight = 4 };
+
+int nLCDButtons = kButtonNone;
+bool bLCDBacklight = false;
+
+inline void clearLCDLine(int line) {}
+inline void displayLCDChar(int line, int column, int c) {}
+inline void displayLCDString(int line, int column, const char * text) {}
+inline void displayLCDCenteredString(int line, const char * text) {}
+
+inline int sgn(float x) {
+    return x > 0 ? 1 : x < 0 ? -1 : 0;
+}
+
+// Debug stream, after the simulated time
+FILE * robotcDebugStream = stdout;
+
+void writeDebugStreamLine(const char * format, ...) {
+    va_list args;
+    va_start(args, format);
+    fprintf(robotcDebugStream, "%7d  ", nSysTime);
+    vfprintf(robotcDebugStream, format, args);
+    fprintf(robotcDebugStream, "\n");
+    va_end(args);
+}
+
+// UARTs. Every port is stdin and stdout, read without blocking if the program set that up
+enum TUARTs { uartOne, uartTwo };
+
+bool robotcPortClosed = false;
+
+int getChar(TUARTs port) {
+    unsigned char c;
+    int count = read(0, &c, 1);
+    if (count == 0) robotcPortClosed = true;
+    return count == 1 ? c : -1;
+}
+
+void sendChar(TUARTs port, int c) {
+    unsigned char byte = c;
+    write(1, &byte, 1);
+}
+
+// Semaphores, with one task there is nobody to wait for
+typedef int TSemaphore;
+
+inline void semaphoreInitialize(TSemaphore & semaphore) {
+    semaphore = 0;
+}
+
+inline void semaphoreLock(TSemaphore & semaphore, int timeout = 0) {
+    semaphore = 1;
+}
+
+inline void semaphoreUnlock(TSemaphore & semaphore) {
+    semaphore = 0;
+}
+
+inline bool bDoesTaskOwnSemaphore(TSemaphore & semaphore) {
+    return semaphore != 0;
+}
+
+#endif
@@ -0,0 +1,224 @@
+/**
+ * sim.cpp - Runs the HAL on a PC, against a simulated flywheel and drive
+ *
+ *  sim scenario.txt trace.csv
+ *
+ * Every 20ms cycle, the events the scenario has due are applied, the flywheel plant runs for 20 1ms steps on
+ * whatever motor[] the HAL left it, and then halStep() runs, exactly as hal.c has it. Writes a trace row per cycle,
+ * prints the debug stream as it goes, and the flywheel metrics (metrics.c) and ball flow (ballflow.c) at the end. tools/sim.py builds this and
+ * compares the results against the golden runs.
+ *
+ * The flywheel and drive are plant.h. Scenario lines are "<ms> <command> <arguments>", in time order, # for comments:
+ *  press <button>, release <button>    Btn5U, Btn7U, ... as in vexRT
+ *  stick <channel> <value>             Ch1 - Ch4
+ *  battery <mV>
+ *  sonar <cm>                          Ball detector reading (-1 for no echo)
+ *  shot <RPM>                          A ball leaving the flywheel takes this much speed with it
+ *  ball <RPM>                          A ball reaches the intake, and takes this much speed when the flywheel shoots it.
+ *                                      Once a scenario has balls they drive the ball detector, so don't mix with sonar
+ *  set <name> <value>                  A tunable, by its console name (the ones in simParams), for what-ifs
+ *  plant <free RPM> <time constant ms>
+ *  spin <RPM>                          Flywheel setpoint, as the console's spin
+ *  push <ticks per second>             Something pushing the robot forward (negative for back)
+ *  encoder <sensor> oneway|ok          flywheel, leftDrive or rightDrive loses a channel and counts up only, or is fixed
+ *  end                                 Stop here
+ */
+
+#include <string.h>
+
+#include "robotc.h"
+#include "ports.h"
+
+// hal.c with its includes in place, once each (see tools/sim.py)
+#define PROFILE_ENABLED 0
+#include "hal.c"
+
+#include "plant.h"
+
+#define SCENARIO_LINE 128
+
+const char * joystickNames[kNumbOfVexRFIndices] = {
+    "Ch1", "Ch2", "Ch3", "Ch4",
+    "Btn5D", "Btn5U", "Btn6D", "Btn6U",
+    "Btn7D", "Btn7L", "Btn7R", "Btn7U",
+    "Btn8D", "Btn8L", "Btn8R", "Btn8U"
+};
+
+int sensorIndex(const char * name) {
+    if (strcmp(name, "flywheel") == 0) return flywheel;
+    if (strcmp(name, "leftDrive") == 0) return leftDrive;
+    if (strcmp(name, "rightDrive") == 0) return rightDrive;
+
+    fprintf(stderr, "unknown encoder %s\n", name);
+    exit(2);
+}
+
+// Tunables scenarios can set, by console name
+struct SimParam {
+    const char * name;
+    int * value;
+};
+
+SimParam simParams[] = {
+    { "fly_hold", &doubleShotHold },
+    { "fire_err", &fireMaxError },
+    { "fire_min", &fireMinSetpoint },
+    { "index_pwr", &indexerPower },
+    { "dbl_reset", &doubleShotReset }
+};
+
+int * simParam(const char * name) {
+    for(int i = 0; i < (int)(sizeof(simParams) / sizeof(simParams[0])); i++) {
+        if (strcmp(name, simParams[i].name) == 0) return simParams[i].value;
+    }
+
+    fprintf(stderr, "unknown parameter %s\n", name);
+    exit(2);
+}
+
+int joystickIndex(const char * name) {
+    for(int i = 0; i < kNumbOfVexRFIndices; i++) {
+        if (strcmp(name, joystickNames[i]) == 0) return i;
+    }
+
+    fprintf(stderr, "unknown joystick input %s\n", name);
+    exit(2);
+}
+
+/**
+ * Applies a scenario line
+ * @return bool Whether the run should go on
+ */
+bool scenarioApply(char * command, char * first, char * second) {
+    if (strcmp(command, "press") == 0) {
+        vexRT[joystickIndex(first)] = 1;
+    } else if (strcmp(command, "release") == 0) {
+        vexRT[joystickIndex(first)] = 0;
+    } else if (strcmp(command, "stick") == 0) {
+        vexRT[joystickIndex(first)] = atoi(second);
+    } else if (strcmp(command, "battery") == 0) {
+        nAvgBatteryLevel = atoi(first);
+        nImmediateBatteryLevel = nAvgBatteryLevel;
+    } else if (strcmp(command, "sonar") == 0) {
+        SensorValue[ballDetector] = atoi(first);
+    } else if (strcmp(command, "shot") == 0) {
+        plant.rpm -= atof(first);
+    } else if (strcmp(command, "ball") == 0) {
+        ballArrive(atof(first));
+    } else if (strcmp(command, "set") == 0) {
+        *simParam(first) = atoi(second);
+    } else if (strcmp(command, "plant") == 0) {
+        plant.freeRPM = atof(first);
+        plant.timeConstant = atof(second);
+    } else if (strcmp(command, "spin") == 0) {
+        targetTBH(robot.flywheel, atof(first));
+    } else if (strcmp(command, "push") == 0) {
+        drivePlant.push = atof(first) / 1000.0;
+    } else if (strcmp(command, "encoder") == 0) {
+        encoderOneWay[sensorIndex(first)] = strcmp(second, "oneway") == 0;
+    } else if (strcmp(command, "end") == 0) {
+        return false;
+    } else {
+        fprintf(stderr, "unknown scenario command %s\n", command);
+        exit(2);
+    }
+    return true;
+}
+
+void traceRow(FILE * trace) {
+    fprintf(trace, "%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d\n", nSysTime,
+        (int)round(robot.flywheel.setpoint), (int)round(robot.flywheel.process), (int)round(robot.flywheel.output),
+        (int)round(plant.rpm), motor[FlywheelOut], motor[Indexer], motor[Intake],
+        robot.ballLoaded, robot.firing, robot.doubleShotMode,
+        robot.leftDrive, (int)round(robot.leftVelocity), flywheelEncoder.fault, leftEncoder.fault, rightEncoder.fault,
+        balls.count);
+}
+
+// metrics.c only keeps the last and best of each, the worst is what a regression shows up in
+int metricsSeen[METRIC_COUNT];
+int metricsWorst[METRIC_COUNT];
+
+void metricsFollow() {
+    for(int i = 0; i < METRIC_COUNT; i++) {
+        if (metrics.samples[i] != metricsSeen[i]) {
+            metricsSeen[i] = metrics.samples[i];
+            if (metrics.last[i] > metricsWorst[i]) metricsWorst[i] = metrics.last[i];
+        }
+    }
+}
+
+void metricsReport() {
+    const char * names[METRIC_COUNT] = { "spinup", "settle", "recovery", "cadence" };
+
+    // name, samples, best and worst (ms)
+    for(int i = 0; i < METRIC_COUNT; i++) {
+        printf("metric %s %d %d %d\n", names[i], metrics.samples[i], metrics.best[i], metricsWorst[i]);
+    }
+    printf("shots %d\n", metrics.shots);
+}
+
+void flowSummary() {
+    flowReport();
+
+    // shots, bursts, balls per second, then ms each ball waited by stage
+    printf("flow %d %d %.3f\n", flow.shots, flow.bursts, flowRate());
+    for(int i = 0; i < FLOW_STAGES; i++) {
+        printf("stage %s %d\n", flowStageNames[i], flowAverage(i));
+    }
+}
+
+int main(int argc, char ** argv) {
+    if (argc != 3) {
+        fprintf(stderr, "usage: sim scenario.txt trace.csv\n");
+        return 2;
+    }
+
+    FILE * scenario = fopen(argv[1], "r");
+    FILE * trace = fopen(argv[2], "w");
+    if (!scenario || !trace) {
+        fprintf(stderr, "can't open %s or %s\n", argv[1], argv[2]);
+        return 2;
+    }
+
+    // Nothing in front of the ball detector
+    SensorValue[ballDetector] = 30;
+
+    initHAL();
+    fprintf(trace, "time,setpoint,process,output,rpm,flywheel,indexer,intake,loaded,firing,double_shot,"
+        "drive,velocity,flywheel_encoder,left_encoder,right_encoder,balls\n");
+
+    char line[SCENARIO_LINE];
+    bool pending = false; // line holds an event that isn't due yet
+    int at = 0;
+    char command[SCENARIO_LINE], first[SCENARIO_LINE], second[SCENARIO_LINE];
+    bool running = true;
+
+    while(running) {
+        // Events due by the next cycle
+        while(running) {
+            if (!pending) {
+                if (!fgets(line, SCENARIO_LINE, scenario)) break;
+
+                first[0] = second[0] = 0;
+                if (line[0] == '#' || sscanf(line, "%d %s %s %s", &at, command, first, second) < 2) continue;
+                pending = true;
+            }
+
+            if (at > nSysTime + HAL_PERIOD) break;
+            pending = false;
+            running = scenarioApply(command, first, second);
+        }
+        if (!running) break;
+
+        plantCycle();
+        metricsFollow();
+        traceRow(trace);
+
+        if (!pending && feof(scenario)) break;
+    }
+
+    fclose(trace);
+    metricsReport();
+    flowSummary();
+    return 0;
+}
@@ -0,0 +1,267 @@
+#!/usr/bin/env python3
+"""
+Builds the HAL for the PC (tools/host) and runs it through the scenarios in tools/host/scenarios, checking every run
+against its golden trace and metric baselines in tools/host/golden.
+
+    python3 tools/sim.py                         # every scenario, exits 1 on any difference or regression
+    python3 tools/sim.py double_shot --log       # one scenario, printing the robot's debug stream
+    python3 tools/sim.py double_shot --trace out.csv
+    python3 tools/sim.py --update                # rewrite the golden traces after an intended change
+    python3 tools/sim.py flow --set index_pwr=100    # what if: a tunable changed from the start of the run
+
+The golden trace is the exact run, cycle by cycle, so any change in behaviour shows up as a difference; look at it,
+and if it was meant, --update. Baselines are the slowest spin up, settle, recovery and cadence (ms) each scenario may
+take, with the same tolerance as on the robot (METRICS_TOLERANCE in lib/metrics.c). They are only ever edited by hand,
+so a tuning change that makes the flywheel slower fails here even after the traces are updated.
+
+Scenarios with balls also report ball flow as the robot measures it (lib/ballflow.c): balls per second within bursts,
+and where each ball waited on average. With --set, that answers what-ifs (a faster indexer, a shorter double shot
+reset) without the robot; --set runs are not checked against the golden traces.
+
+Needs g++.
+"""
+
+import argparse
+import csv
+import json
+import os
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+
+TOOLS = os.path.dirname(os.path.abspath(__file__))
+ROOT = os.path.dirname(TOOLS)
+HOST = os.path.join(TOOLS, "host")
+SCENARIOS = os.path.join(HOST, "scenarios")
+GOLDEN = os.path.join(HOST, "golden")
+BASELINES = os.path.join(GOLDEN, "baselines.json")
+
+METRIC_NAMES = ["spinup", "settle", "recovery", "cadence"]
+FLOW_STAGES = ["intake", "sonar", "flywheel", "command", "feed", "reset"]
+
+# Largest difference allowed from the golden trace, for floating point that rounds the other way on another machine
+TRACE_TOLERANCE = 1
+
+COMPILER = "g++"
+FLAGS = ["-std=gnu++98", "-fpermissive", "-w", "-O1"]
+
+
+def read_ports(path=os.path.join(ROOT, "main.c")):
+    """Port names from the #pragma config block, as RobotC numbers them"""
+    ports = []
+    with open(path) as source:
+        for kind, port, name in re.findall(r"#pragma config\((Sensor|Motor),\s*(\w+),\s*(\w+)", source.read()):
+            if kind == "Motor":
+                number = int(port[len("port"):]) - 1
+            elif port.startswith("dgtl"):
+                number = int(port[len("dgtl"):]) + 7
+            else:
+                number = int(port[len("in"):]) - 1
+            ports.append((name, number))
+    return ports
+
+
+def flatten(path, seen, out):
+    """
+    Writes a source file with its includes in place. RobotC only includes a file the first time it is named, which
+    the lib files rely on (most include util.c), so the same is done here rather than by the C preprocessor
+    """
+    path = os.path.normpath(path)
+    if path in seen:
+        return
+    seen.add(path)
+
+    out.write('#line 1 "%s"\n' % path)
+    with open(path) as source:
+        for number, line in enumerate(source, 1):
+            match = re.match(r'\s*#include "(.+)"', line)
+            if match and match.group(1) == "Vex_Competition_Includes.c":
+                # The competition template's task main, which the host programs replace
+                out.write("\n")
+            elif match:
+                flatten(os.path.join(os.path.dirname(path), match.group(1).replace("\\", "/")), seen, out)
+                out.write('#line %d "%s"\n' % (number + 1, path))
+            else:
+                out.write(line)
+    out.write("\n")
+
+
+def build(directory, program="sim", robot_file="hal.c"):
+    """
+    Builds a host program (tools/host/<program>.cpp) into directory, returning its path. The program includes
+    robot_file (relative to the repository) by its file name, already flattened
+    """
+    with open(os.path.join(directory, os.path.basename(robot_file)), "w") as out:
+        flatten(os.path.join(ROOT, robot_file), set(), out)
+
+    with open(os.path.join(directory, "ports.h"), "w") as header:
+        header.write("// Generated by tools/sim.py from main.c\n")
+        for name, number in read_ports():
+            header.write("const int %s = %d;\n" % (name, number))
+
+    binary = os.path.join(directory, program)
+    subprocess.check_call([COMPILER] + FLAGS + ["-I", directory, "-o", binary, os.path.join(HOST, program + ".cpp")])
+    return binary
+
+
+def scenarios():
+    return sorted(name[:-len(".txt")] for name in os.listdir(SCENARIOS) if name.endswith(".txt"))
+
+
+class Run(object):
+    def __init__(self, trace, log, metrics, shots, flow):
+        self.trace = trace      # Rows, as dicts of ints
+        self.log = log          # Debug stream lines
+        self.metrics = metrics  # name: (samples, best, worst)
+        self.shots = shots
+        self.flow = flow        # shots, bursts, rate (balls per second), and ms per ball in each of FLOW_STAGES
+
+
+def run(binary, scenario, extra=""):
+    """Runs a scenario (a name in tools/host/scenarios, or a path), with extra scenario lines after it"""
+    path = scenario if os.path.exists(scenario) else os.path.join(SCENARIOS, scenario + ".txt")
+    directory = tempfile.mkdtemp()
+    try:
+        script = os.path.join(directory, "scenario.txt")
+        with open(path) as source, open(script, "w") as out:
+            out.write(extra + "\n" + source.read())
+
+        trace_path = os.path.join(directory, "trace.csv")
+        output = subprocess.check_output([binary, script, trace_path], universal_newlines=True)
+        with open(trace_path) as trace:
+            rows = [dict((key, int(value)) for key, value in row.items()) for row in csv.DictReader(trace)]
+    finally:
+        shutil.rmtree(directory)
+
+    log, metrics, shots, flow = [], {}, 0, {}
+    for line in output.splitlines():
+        fields = line.split()
+        if fields and fields[0] == "metric":
+            metrics[fields[1]] = tuple(int(value) for value in fields[2:])
+        elif fields and fields[0] == "shots":
+            shots = int(fields[1])
+        elif fields and fields[0] == "flow":
+            flow.update(shots=int(fields[1]), bursts=int(fields[2]), rate=float(fields[3]))
+        elif fields and fields[0] == "stage":
+            flow[fields[1]] = int(fields[2])
+        else:
+            log.append(line)
+    return Run(rows, log, metrics, shots, flow)
+
+
+def settings(pairs):
+    """Scenario lines setting tunables from the start, from name=value pairs"""
+    return "\n".join("0 set %s %s" % tuple(pair.split("=", 1)) for pair in pairs)
+
+
+def flow_summary(flow):
+    return "%.2f balls/s over %d shots, ms per ball: %s" % (
+        flow["rate"], flow["shots"], ", ".join("%s %d" % (stage, flow[stage]) for stage in FLOW_STAGES))
+
+
+def compare_traces(rows, golden):
+    """(time, field, value, expected) for every field further than TRACE_TOLERANCE from the golden run"""
+    mismatches = []
+    for row, expected in zip(rows, golden):
+        for field in expected:
+            if abs(row.get(field, 0) - expected[field]) > TRACE_TOLERANCE:
+                mismatches.append((expected["time"], field, row.get(field, 0), expected[field]))
+    if len(rows) != len(golden):
+        mismatches.append((rows[-1]["time"] if rows else 0, "cycles", len(rows), len(golden)))
+    return mismatches
+
+
+def read_tolerance(path=os.path.join(ROOT, "lib", "metrics.c")):
+    with open(path) as source:
+        return int(re.search(r"#define METRICS_TOLERANCE (\d+)", source.read()).group(1))
+
+
+def regressions(metrics, baselines, tolerance):
+    """(metric, worst, baseline) for every metric slower than its baseline allows, or never measured"""
+    found = []
+    for name, baseline in sorted(baselines.items()):
+        samples, best, worst = metrics.get(name, (0, 0, 0))
+        if samples == 0 or worst * 100 > baseline * (100 + tolerance):
+            found.append((name, worst if samples else None, baseline))
+    return found
+
+
+def golden_path(scenario):
+    return os.path.join(GOLDEN, scenario + ".csv")
+
+
+def load_golden(scenario):
+    with open(golden_path(scenario)) as trace:
+        return [dict((key, int(value)) for key, value in row.items()) for row in csv.DictReader(trace)]
+
+
+def write_trace(rows, path):
+    with open(path, "w") as out:
+        writer = csv.DictWriter(out, fieldnames=list(rows[0].keys()), lineterminator="\n")
+        writer.writeheader()
+        writer.writerows(rows)
+
+
+def load_baselines():
+    with open(BASELINES) as source:
+        return json.load(source)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("scenarios", nargs="*", help="default: all of them")
+    parser.add_argument("--update", action="store_true", help="rewrite the golden traces")
+    parser.add_argument("--trace", help="write the trace here (one scenario)")
+    parser.add_argument("--log", action="store_true", help="print the debug stream")
+    parser.add_argument("--set", action="append", default=[], metavar="NAME=VALUE",
+                        help="set a tunable (console name) for a what-if, skipping the golden traces")
+    args = parser.parse_args()
+
+    names = args.scenarios or scenarios()
+    baselines = load_baselines()
+    tolerance = read_tolerance()
+    failed = False
+
+    directory = tempfile.mkdtemp()
+    try:
+        binary = build(directory)
+
+        for name in names:
+            result = run(binary, name, settings(args.set))
+            if args.log:
+                print("\n".join(result.log))
+            if args.trace:
+                write_trace(result.trace, args.trace)
+
+            summary = ", ".join("%s %d" % (metric, result.metrics[metric][2])
+                                for metric in METRIC_NAMES if result.metrics.get(metric, (0,))[0] > 0)
+            print("%s: %d cycles, %d shots, worst %s" % (name, len(result.trace), result.shots, summary or "none"))
+            if result.flow.get("shots"):
+                print("  flow: %s" % flow_summary(result.flow))
+
+            if args.set:
+                continue
+            elif args.update:
+                write_trace(result.trace, golden_path(name))
+            else:
+                mismatches = compare_traces(result.trace, load_golden(name))
+                for time, field, value, expected in mismatches[:10]:
+                    print("  MISMATCH %s at %d ms: %d, golden %d" % (field, time, value, expected))
+                if len(mismatches) > 10:
+                    print("  ... %d more" % (len(mismatches) - 10))
+                failed = failed or len(mismatches) > 0
+
+            for metric, worst, baseline in regressions(result.metrics, baselines.get(name, {}), tolerance):
+                print("  REGRESSION %s: %s ms, baseline %d ms" % (metric, "never measured" if worst is None else worst,
+                                                                    baseline))
+                failed = True
+    finally:
+        shutil.rmtree(directory)
+
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
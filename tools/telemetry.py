@@ -0,0 +1,204 @@
+#!/usr/bin/env python3
+"""
+Decodes (and optionally plots) a capture of the binary telemetry stream from lib/telemetry.c.
+
+Capture the console UART to a file while the robot streams ("stream 50" on the console), then:
+
+    python3 tools/telemetry.py capture.bin                 # summary
+    python3 tools/telemetry.py capture.bin --csv out.csv   # state frames as CSV
+    python3 tools/telemetry.py capture.bin --plot          # flywheel and drive plots (needs matplotlib)
+
+Without a robot, tools/console_pty.py puts a simulated one on a pseudo terminal to capture from.
+
+The frame layout here must match lib/telemetry.c.
+"""
+
+import argparse
+import csv
+import struct
+import sys
+
+SYNC = b"\xa5\x5a"
+
+TELEMETRY_STATE = 1
+TELEMETRY_PROFILE = 2
+TELEMETRY_TEXT = 3
+
+# See telemetrySendState()
+STATE_FORMAT = "<Ihhhb10bbbiihhBBBBHBBHB"
+STATE_FIELDS = (
+    ["time", "setpoint", "process", "error", "output"]
+    + ["motor%d" % port for port in range(1, 11)]
+    + ["left_command", "right_command", "left_encoder", "right_encoder", "heading", "ball_detector",
+       "flags", "double_shot", "intake", "indexer", "battery", "indexer_jams", "intake_jams",
+       "deadline_misses", "degraded"]
+)
+STATE_LENGTH = struct.calcsize(STATE_FORMAT)
+
+# See profile.c, in slot order
+PROFILE_SLOTS = ["hal", "measure", "drive", "taker", "flywheel", "motor", "thermal", "lcd",
+                 "lcd_input", "console", "telemetry", "watchdog"]
+PROFILE_FORMAT = "<HBBHH"
+PROFILE_BUSY_FORMAT = "<H"  # After the slots
+
+
+def fletcher16(data):
+    sum1 = sum2 = 0
+    for byte in data:
+        sum1 = (sum1 + byte) % 255
+        sum2 = (sum2 + sum1) % 255
+    return sum1, sum2
+
+
+class Frame(object):
+    def __init__(self, type, sequence, payload):
+        self.type = type
+        self.sequence = sequence
+        self.payload = payload
+
+
+class Stream(object):
+    """Everything decoded from a capture, plus what had to be thrown away"""
+
+    def __init__(self):
+        self.frames = []
+        self.bad_checksums = 0
+        self.skipped_bytes = 0  # Bytes outside any frame (text from before the stream started, noise)
+        self.dropped_frames = 0  # From gaps in the sequence numbers
+
+    def of_type(self, type):
+        return [frame for frame in self.frames if frame.type == type]
+
+    def states(self):
+        return [decode_state(frame.payload) for frame in self.of_type(TELEMETRY_STATE)]
+
+    def profiles(self):
+        return [decode_profile(frame.payload) for frame in self.of_type(TELEMETRY_PROFILE)]
+
+    def text(self):
+        return [frame.payload.decode("ascii", "replace") for frame in self.of_type(TELEMETRY_TEXT)]
+
+
+def decode_state(payload):
+    if len(payload) != STATE_LENGTH:
+        raise ValueError("state payload is %d bytes, expected %d" % (len(payload), STATE_LENGTH))
+
+    state = dict(zip(STATE_FIELDS, struct.unpack(STATE_FORMAT, payload)))
+    state["heading"] /= 10.0
+    state["ball_loaded"] = bool(state["flags"] & 1)
+    state["firing"] = bool(state["flags"] & 2)
+    state["flywheel_control_disabled"] = bool(state["flags"] & 4)
+    return state
+
+
+def decode_profile(payload):
+    """Figures for each slot by name, and "busy_percent", the CPU used by every task"""
+    size = struct.calcsize(PROFILE_FORMAT)
+    expected = size * len(PROFILE_SLOTS) + struct.calcsize(PROFILE_BUSY_FORMAT)
+    if len(payload) != expected:
+        raise ValueError("profile payload is %d bytes, expected %d" % (len(payload), expected))
+
+    profile = {}
+    for i, name in enumerate(PROFILE_SLOTS):
+        average, fastest, slowest, share, iterations = struct.unpack_from(PROFILE_FORMAT, payload, i * size)
+        profile[name] = {"average_ms": average / 100.0, "fastest_ms": fastest, "slowest_ms": slowest,
+                         "share_percent": share / 10.0, "iterations": iterations}
+    profile["busy_percent"] = struct.unpack_from(PROFILE_BUSY_FORMAT, payload, size * len(PROFILE_SLOTS))[0] / 10.0
+    return profile
+
+
+def decode(data):
+    """Scans a capture for frames, dropping anything that doesn't check out"""
+    stream = Stream()
+    position = 0
+    last_sequence = None
+
+    while True:
+        start = data.find(SYNC, position)
+        if start < 0:
+            stream.skipped_bytes += len(data) - position
+            break
+
+        stream.skipped_bytes += start - position
+
+        # Header: type, length, sequence
+        if start + 5 > len(data):
+            stream.skipped_bytes += len(data) - start
+            break
+        type, length, sequence = data[start + 2], data[start + 3], data[start + 4]
+        end = start + 5 + length + 2
+        if end > len(data):
+            stream.skipped_bytes += len(data) - start
+            break
+
+        if fletcher16(data[start + 2:end - 2]) != (data[end - 2], data[end - 1]):
+            # Not a frame after all (or a damaged one), resync from the next byte
+            stream.bad_checksums += 1
+            stream.skipped_bytes += 1
+            position = start + 1
+            continue
+
+        if last_sequence is not None:
+            stream.dropped_frames += (sequence - last_sequence - 1) % 256
+        last_sequence = sequence
+
+        stream.frames.append(Frame(type, sequence, bytes(data[start + 5:end - 2])))
+        position = end
+
+    return stream
+
+
+def write_csv(states, path):
+    with open(path, "w") as out:
+        writer = csv.DictWriter(out, fieldnames=STATE_FIELDS, extrasaction="ignore")
+        writer.writeheader()
+        writer.writerows(states)
+
+
+def plot(states):
+    import matplotlib.pyplot as plt
+
+    time = [(state["time"] - states[0]["time"]) / 1000.0 for state in states]
+
+    figure, (flywheel, drive) = plt.subplots(2, 1, sharex=True)
+    flywheel.plot(time, [state["setpoint"] for state in states], label="setpoint")
+    flywheel.plot(time, [state["process"] for state in states], label="process")
+    flywheel.set_ylabel("RPM")
+    flywheel.legend()
+
+    drive.plot(time, [state["left_command"] for state in states], label="left")
+    drive.plot(time, [state["right_command"] for state in states], label="right")
+    drive.plot(time, [state["heading"] for state in states], label="heading")
+    drive.set_xlabel("s")
+    drive.legend()
+
+    plt.show()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("capture")
+    parser.add_argument("--csv", help="write state frames to this file")
+    parser.add_argument("--plot", action="store_true")
+    args = parser.parse_args()
+
+    with open(args.capture, "rb") as capture:
+        stream = decode(capture.read())
+
+    states = stream.states()
+    print("%d state, %d profile, %d text frames" % (len(states), len(stream.profiles()), len(stream.text())))
+    print("%d dropped, %d bad checksums, %d bytes outside frames" %
+          (stream.dropped_frames, stream.bad_checksums, stream.skipped_bytes))
+    for line in stream.text():
+        print("> " + line)
+
+    if args.csv:
+        write_csv(states, args.csv)
+    if args.plot and states:
+        plot(states)
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
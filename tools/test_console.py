@@ -0,0 +1,78 @@
+#!/usr/bin/env python3
+"""
+Talks to the robot's console through the stand-in (tools/console_pty.py): parameter ranges, and a telemetry stream
+that tools/telemetry.py decodes. Skipped without g++ or pseudo terminals.
+
+    python3 -m unittest discover tools
+"""
+
+import os
+import shutil
+import time
+import unittest
+
+import console_pty
+import sim
+import telemetry
+
+
+@unittest.skipIf(shutil.which(sim.COMPILER) is None or not hasattr(os, "openpty"), "needs %s and a pty" % sim.COMPILER)
+class ConsoleTest(unittest.TestCase):
+
+    @classmethod
+    def setUpClass(cls):
+        cls.console = console_pty.Console()
+
+    @classmethod
+    def tearDownClass(cls):
+        cls.console.close()
+
+    def test_set_in_range(self):
+        self.assertEqual(self.console.command("set fire_min 1200"), "fire_min=1200.00000")
+        self.assertEqual(self.console.command("get fire_min"), "fire_min=1200.00000")
+
+    def test_out_of_range_is_rejected(self):
+        before = self.console.command("get fly_ki")
+        self.assertEqual(self.console.command("set fly_ki -0.001"), "ERR out of range")
+        self.assertEqual(self.console.command("set fire_min -5"), "ERR out of range")
+        self.assertEqual(self.console.command("set preset_u 9000"), "ERR out of range")
+        self.assertEqual(self.console.command("get fly_ki"), before)
+
+    def test_schedule_uses_the_ranges(self):
+        self.assertEqual(self.console.command("sched 2 -0.002 750"), "ERR bad ki")
+        self.assertEqual(self.console.command("sched 2 0.002 -1"), "ERR bad bang")
+        self.assertEqual(self.console.command("sched 2 0.002 750"), "OK")
+
+    def test_bad_input(self):
+        self.assertEqual(self.console.command("set nope 1"), "ERR unknown parameter")
+        self.assertEqual(self.console.command("set fire_min abc"), "ERR bad value")
+        self.assertEqual(self.console.command("bogus"), "ERR unknown command")
+
+    def test_stream(self):
+        self.assertEqual(self.console.command("spin 2500"), "OK")
+        # Replies come back in text frames once streaming
+        self.console.send("stream 50")
+        time.sleep(0.5)
+        self.console.send("stream 0")
+        time.sleep(0.1)
+
+        os.set_blocking(self.console.port, False)
+        captured = self.console.pending
+        try:
+            while True:
+                captured += os.read(self.console.port, 4096)
+        except BlockingIOError:
+            pass
+        self.console.pending = b""
+
+        stream = telemetry.decode(captured)
+        states = stream.states()
+        self.assertGreater(len(states), 5)
+        self.assertEqual(stream.bad_checksums, 0)
+        self.assertEqual(states[-1]["setpoint"], 2500)
+        self.assertGreater(states[-1]["process"], states[0]["process"])
+        self.assertEqual(stream.text(), ["OK"])
+
+
+if __name__ == "__main__":
+    unittest.main()
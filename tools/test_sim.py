@@ -0,0 +1,110 @@
+#!/usr/bin/env python3
+"""
+Runs the HAL on the host (tools/sim.py) through every scenario, against the golden traces and baselines in
+tools/host/golden, and checks the simulator catches what it is there to catch. Skipped without g++.
+
+    python3 -m unittest discover tools
+"""
+
+import shutil
+import tempfile
+import unittest
+
+import sim
+
+
+@unittest.skipIf(shutil.which(sim.COMPILER) is None, "needs %s" % sim.COMPILER)
+class SimTest(unittest.TestCase):
+
+    @classmethod
+    def setUpClass(cls):
+        cls.directory = tempfile.mkdtemp()
+        cls.binary = sim.build(cls.directory)
+        cls.baselines = sim.load_baselines()
+        cls.tolerance = sim.read_tolerance()
+
+    @classmethod
+    def tearDownClass(cls):
+        shutil.rmtree(cls.directory)
+
+    def test_ports_from_main(self):
+        ports = dict(sim.read_ports())
+        self.assertEqual(ports["Indexer"], 0)
+        self.assertEqual(ports["FlywheelOut"], 1)
+        self.assertEqual(ports["gyro"], 0)
+        self.assertEqual(ports["flywheel"], 10)
+        self.assertEqual(ports["ballDetector"], 18)
+
+    def test_scenarios_match_golden(self):
+        for name in sim.scenarios():
+            result = sim.run(self.binary, name)
+            self.assertEqual(sim.compare_traces(result.trace, sim.load_golden(name)), [], name)
+            self.assertEqual(sim.regressions(result.metrics, self.baselines.get(name, {}), self.tolerance), [],
+                             name)
+
+    def test_slower_flywheel_regresses(self):
+        # Twice the time constant, as if the flywheel had gained a lot of inertia
+        result = sim.run(self.binary, "spinup", "0 plant 3600 700")
+        regressed = [metric for metric, worst, baseline in
+                     sim.regressions(result.metrics, self.baselines["spinup"], self.tolerance)]
+        self.assertIn("spinup", regressed)
+        self.assertNotEqual(sim.compare_traces(result.trace, sim.load_golden("spinup")), [])
+
+    def test_double_shot(self):
+        trace = sim.run(self.binary, "double_shot").trace
+        modes = [row["double_shot"] for row in trace]
+
+        # Straight from before the first shot to holding for the second, then reset by the timeout
+        self.assertEqual(sorted(set(modes)), [0, 1, 3])
+        held = [row for row in trace if row["double_shot"] == 3]
+        self.assertTrue(all(row["output"] == 39 for row in held))
+        self.assertGreaterEqual(held[-1]["time"] - held[0]["time"], 2000)
+        self.assertEqual(trace[-1]["double_shot"], 0)
+
+    def test_encoder_reversed(self):
+        # Braking and being pushed both count against the command, but only a lost channel counts one way regardless
+        for name in ["encoder_coast", "encoder_push"]:
+            trace = sim.run(self.binary, name).trace
+            self.assertFalse(any(row[field] for row in trace
+                                 for field in ["flywheel_encoder", "left_encoder", "right_encoder"]), name)
+
+        trace = sim.run(self.binary, "encoder_lost").trace
+        reversed_rows = [row for row in trace if row["left_encoder"] == 3]
+        self.assertTrue(reversed_rows)
+        self.assertGreater(reversed_rows[0]["time"], 2500)
+        # Counted from the command while reversed, and trusted again once it counts back with it
+        self.assertTrue(all(row["velocity"] < 0 for row in reversed_rows))
+        self.assertLess(reversed_rows[-1]["time"], 7000)
+        self.assertEqual(trace[-1]["left_encoder"], 0)
+        self.assertFalse(any(row["right_encoder"] for row in trace))
+
+    def test_flow(self):
+        flow = sim.run(self.binary, "flow").flow
+        self.assertEqual(flow["shots"], 4)
+        self.assertEqual(flow["bursts"], 1)
+        self.assertGreater(flow["rate"], 2)
+
+        # What if: a faster indexer feeds each ball in quicker
+        faster = sim.run(self.binary, "flow", sim.settings(["index_pwr=100"])).flow
+        self.assertLess(faster["feed"], flow["feed"])
+
+    def test_double_shot_reset(self):
+        flow = sim.run(self.binary, "flow_double").flow
+        self.assertEqual(flow["shots"], 6)
+        self.assertGreater(flow["reset"], 0)
+
+        # What if: the double shot resets in half the time
+        shorter = sim.run(self.binary, "flow_double", sim.settings(["dbl_reset=1000"])).flow
+        self.assertLess(shorter["reset"], flow["reset"])
+
+    def test_trace_difference(self):
+        golden = sim.load_golden("spinup")
+        changed = [dict(row) for row in golden]
+        changed[50]["flywheel"] += 5
+        self.assertEqual(sim.compare_traces(changed, golden), [(golden[50]["time"], "flywheel",
+                                                                golden[50]["flywheel"] + 5, golden[50]["flywheel"])])
+        self.assertEqual(sim.compare_traces(changed[:-1], golden)[-1][1], "cycles")
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,71 @@
+#!/usr/bin/env python3
+"""
+Checks tools/telemetry.py against a capture of the stream (tools/recordings/stream.bin).
+
+The capture holds console text from before streaming started, state, profile and text frames, a frame lost on
+the wire, a damaged frame, line noise between frames, and a final frame cut off by the end of the capture.
+
+    python3 -m unittest discover tools
+"""
+
+import os
+import unittest
+
+import telemetry
+
+RECORDING = os.path.join(os.path.dirname(os.path.abspath(__file__)), "recordings", "stream.bin")
+
+
+class TelemetryTest(unittest.TestCase):
+
+    @classmethod
+    def setUpClass(cls):
+        with open(RECORDING, "rb") as capture:
+            cls.stream = telemetry.decode(capture.read())
+
+    def test_frame_layout_matches_robot(self):
+        # TELEMETRY_STATE_LENGTH in lib/telemetry.c
+        self.assertEqual(telemetry.STATE_LENGTH, 46)
+
+    def test_frames(self):
+        self.assertEqual(len(self.stream.states()), 4)
+        self.assertEqual(len(self.stream.profiles()), 1)
+        self.assertEqual(self.stream.text(), ["OK", "shots 3 1.25/s"])
+
+    def test_losses_are_counted(self):
+        # Sequence 4 never arrived and 5 was damaged
+        self.assertEqual(self.stream.dropped_frames, 2)
+        self.assertEqual(self.stream.bad_checksums, 1)
+        self.assertGreater(self.stream.skipped_bytes, 0)
+
+    def test_state(self):
+        first = self.stream.states()[0]
+        self.assertEqual(first["time"], 120000)
+        self.assertEqual(first["setpoint"], 2500)
+        self.assertEqual(first["process"], 2300)
+        self.assertEqual(first["error"], 200)
+        self.assertEqual(first["motor1"], 70)
+        self.assertEqual(first["motor5"], -127)
+        self.assertAlmostEqual(first["heading"], 347.5)
+        self.assertEqual(first["battery"], 7650)
+        self.assertTrue(first["firing"])
+        self.assertFalse(first["ball_loaded"])
+        self.assertEqual(first["deadline_misses"], 3)
+
+        # The damaged frame is skipped, not decoded as garbage
+        self.assertEqual([state["time"] for state in self.stream.states()], [120000, 120020, 120060, 120080])
+        self.assertTrue(self.stream.states()[2]["ball_loaded"])
+        self.assertEqual(self.stream.states()[-1]["left_encoder"], 400)
+
+    def test_profile(self):
+        profile = self.stream.profiles()[0]
+        self.assertEqual(profile["hal"]["average_ms"], 5.12)
+        self.assertEqual(profile["hal"]["slowest_ms"], 9)
+        self.assertEqual(profile["lcd"]["share_percent"], 3.0)
+        self.assertEqual(profile["hal"]["iterations"], 50)
+        self.assertEqual(profile["watchdog"]["iterations"], 100)
+        self.assertEqual(profile["busy_percent"], 41.2)
+
+
+if __name__ == "__main__":
+    unittest.main()